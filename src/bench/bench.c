@@ -0,0 +1,299 @@
+#include "bench.h"
+#include "config.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+#include "memory/heap/heap.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "memory/paging/paging.h"
+#include "stdutil/string.h"
+#include "terminal/terminal.h"
+#include <stdbool.h>
+
+// Blocks of the private heap used to measure allocation latency (1MB, it has to fit next to the
+// kernel allocations in the smallest kernel heap, NUTSOS_HEAP_MIN_SIZE_BYTES)
+#define BENCH_HEAP_BLOCKS 256
+#define BENCH_HEAP_ROUNDS 1000
+
+// Every memory routine measurement moves this many bytes in total, whatever the size of each call
+#define BENCH_MEMORY_TOTAL_BYTES (1024 * 1024)
+#define BENCH_MEMORY_MAX_SIZE    (1024 * 1024)
+
+#define BENCH_STRING_ROUNDS 10000
+
+// Address space switches measured, each followed by reads spread over BENCH_SWITCH_PAGES kernel heap pages
+#define BENCH_SWITCH_ROUNDS 1000
+#define BENCH_SWITCH_PAGES  64
+
+static uint32_t bench_random_state = 1;
+
+// Simple LCG, we only need the runs to be repeatable
+static uint32_t bench_random()
+{
+  bench_random_state = bench_random_state * 1103515245 + 12345;
+  return bench_random_state >> 8;
+}
+
+// Average cycles to allocate (and free) total_blocks blocks
+static uint32_t bench_heap_alloc(struct heap *heap, int total_blocks)
+{
+  uint64_t start = cpu_read_tsc();
+  for (int i = 0; i < BENCH_HEAP_ROUNDS; i++) {
+    void *ptr = heap_malloc(heap, total_blocks * NUTSOS_HEAP_BLOCK_SIZE);
+    if (ptr) {
+      heap_free(heap, ptr);
+    }
+  }
+  uint32_t cycles = (uint32_t)(cpu_read_tsc() - start);
+
+  return cycles / BENCH_HEAP_ROUNDS;
+}
+
+// Fill a heap, then free random blocks until only percent of it is in use and measure
+// the allocation latency on the resulting (fragmented) heap
+static void bench_heap_occupancy(int percent)
+{
+  struct heap heap;
+  struct heap_table table;
+
+  void *data = kmalloc(BENCH_HEAP_BLOCKS * NUTSOS_HEAP_BLOCK_SIZE);
+  table.entries = kmalloc(heap_table_size(BENCH_HEAP_BLOCKS));
+  table.total = BENCH_HEAP_BLOCKS;
+  if (!data || !table.entries || heap_create(&heap, data, data + BENCH_HEAP_BLOCKS * NUTSOS_HEAP_BLOCK_SIZE, &table) < 0) {
+    print("bench: unable to create the heap\n");
+    goto out;
+  }
+
+  for (int i = 0; i < BENCH_HEAP_BLOCKS; i++) {
+    heap_malloc(&heap, NUTSOS_HEAP_BLOCK_SIZE);
+  }
+
+  int to_free = (BENCH_HEAP_BLOCKS * (100 - percent)) / 100;
+  while (to_free) {
+    int block = bench_random() % BENCH_HEAP_BLOCKS;
+    if (table.entries[block] & HEAP_BLOCK_TABLE_ENTRY_TAKEN) {
+      heap_free(&heap, data + block * NUTSOS_HEAP_BLOCK_SIZE);
+      to_free--;
+    }
+  }
+
+  printf("heap %d%% used: 1 block %u, 4 blocks %u, 16 blocks %u cycles\n",
+         percent,
+         bench_heap_alloc(&heap, 1),
+         bench_heap_alloc(&heap, 4),
+         bench_heap_alloc(&heap, 16));
+
+out:
+  kfree(table.entries);
+  kfree(data);
+}
+
+static void bench_heap()
+{
+  bench_heap_occupancy(10);
+  bench_heap_occupancy(50);
+  bench_heap_occupancy(90);
+}
+
+// Cycles per KiB to memset size bytes at a time (at offset bytes past a page boundary)
+static uint32_t bench_memory_set(void *(*set)(void *ptr, uint8_t c, size_t size), void *buffer, size_t size, int offset)
+{
+  int rounds = BENCH_MEMORY_TOTAL_BYTES / size;
+  uint64_t start = cpu_read_tsc();
+  for (int i = 0; i < rounds; i++) {
+    set(buffer + offset, i, size);
+  }
+  uint32_t cycles = (uint32_t)(cpu_read_tsc() - start);
+
+  return cycles / (BENCH_MEMORY_TOTAL_BYTES / 1024);
+}
+
+// Cycles per KiB to memcpy size bytes at a time (with the destination at offset bytes past a page boundary)
+static uint32_t bench_memory_copy(void (*copy)(void *dest, const void *src, size_t count), void *dest, void *src, size_t size, int offset)
+{
+  int rounds = BENCH_MEMORY_TOTAL_BYTES / size;
+  uint64_t start = cpu_read_tsc();
+  for (int i = 0; i < rounds; i++) {
+    copy(dest + offset, src, size);
+  }
+  uint32_t cycles = (uint32_t)(cpu_read_tsc() - start);
+
+  return cycles / (BENCH_MEMORY_TOTAL_BYTES / 1024);
+}
+
+static void bench_memory()
+{
+  // Leave room past the end of the buffers for the unaligned runs
+  void *src = kmalloc(BENCH_MEMORY_MAX_SIZE + NUTSOS_HEAP_BLOCK_SIZE);
+  void *dest = kmalloc(BENCH_MEMORY_MAX_SIZE + NUTSOS_HEAP_BLOCK_SIZE);
+  if (!src || !dest) {
+    print("bench: unable to allocate the memory buffers\n");
+    goto out;
+  }
+
+  struct cpu_id id;
+  cpu_cpuid(1, &id);
+  bool sse2 = id.edx & CPU_FEATURE_EDX_SSE2;
+
+  print("memory routines in cycles/KiB (aligned/unaligned destination):\n");
+  for (size_t size = 16; size <= BENCH_MEMORY_MAX_SIZE; size <<= 4) {
+    printf("%u bytes: memset rep %u/%u", size, bench_memory_set(memory_set_rep, dest, size, 0), bench_memory_set(memory_set_rep, dest, size, 3));
+    if (sse2) {
+      printf(" sse2 %u/%u", bench_memory_set(memory_set_sse2, dest, size, 0), bench_memory_set(memory_set_sse2, dest, size, 3));
+    }
+
+    printf(", memcpy rep %u/%u", bench_memory_copy(memory_copy_rep, dest, src, size, 0), bench_memory_copy(memory_copy_rep, dest, src, size, 3));
+    if (sse2) {
+      printf(" sse2 %u/%u", bench_memory_copy(memory_copy_sse2, dest, src, size, 0), bench_memory_copy(memory_copy_sse2, dest, src, size, 3));
+    }
+    print("\n");
+  }
+
+out:
+  kfree(src);
+  kfree(dest);
+}
+
+// The byte-at-a-time string functions the word-at-a-time ones in stdutil replaced, kept as reference
+static size_t bench_strlen_bytes(const char *str)
+{
+  size_t len = 0;
+  while (str[len]) {
+    len++;
+  }
+
+  return len;
+}
+
+static int bench_strncmp_bytes(const char *s1, const char *s2, int n)
+{
+  while (n-- && *s1 && (*s1 == *s2)) {
+    s1++;
+    s2++;
+  }
+
+  if (n == -1) {
+    return 0;
+  }
+
+  return (*(unsigned char *)s1 - *(unsigned char *)s2);
+}
+
+static int bench_istrncmp_bytes(const char *s1, const char *s2, int n)
+{
+  while (n-- && *s1 && (tolower(*s1) == tolower(*s2))) {
+    s1++;
+    s2++;
+  }
+
+  if (n == -1) {
+    return 0;
+  }
+
+  return ((unsigned char)tolower(*s1) - (unsigned char)tolower(*s2));
+}
+
+static char *bench_strcpy_bytes(char *dest, const char *src)
+{
+  while ((*(dest++) = *(src++)) != 0) {}
+  return dest;
+}
+
+// Average cycles of a string function call, the macro saves a wrapper per signature
+#define BENCH_STRING(call)                                  \
+  ({                                                        \
+    uint64_t start = cpu_read_tsc();                        \
+    for (int i = 0; i < BENCH_STRING_ROUNDS; i++) {         \
+      call;                                                 \
+    }                                                       \
+    (uint32_t)(cpu_read_tsc() - start) / BENCH_STRING_ROUNDS; \
+  })
+
+static void bench_string()
+{
+  // A FAT 8.3 name and a long path, compared against copies with a different case
+  static const char *samples[] = {"KERNEL  BIN", "0:/bin/programs/with/a/rather/long/path/to/parse/shell.bin"};
+  char upper[128];
+  char copy[128];
+
+  print("string functions in cycles per call (bytes/words):\n");
+  for (int i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    const char *str = samples[i];
+    int len = strlen(str);
+    for (int j = 0; j <= len; j++) {
+      upper[j] = (str[j] >= 'a' && str[j] <= 'z') ? str[j] - 32 : str[j];
+    }
+
+    printf("%d chars: strlen %u/%u", len, BENCH_STRING(bench_strlen_bytes(str)), BENCH_STRING(strlen(str)));
+    printf(", strncmp %u/%u", BENCH_STRING(bench_strncmp_bytes(str, str, len)), BENCH_STRING(strncmp(str, str, len)));
+    printf(", istrncmp %u/%u", BENCH_STRING(bench_istrncmp_bytes(str, upper, len)), BENCH_STRING(istrncmp(str, upper, len)));
+    printf(", strcpy %u/%u\n", BENCH_STRING(bench_strcpy_bytes(copy, str)), BENCH_STRING(strcpy(copy, str)));
+  }
+}
+
+// Average cycles to switch to the task address space and back, touching the kernel working set
+// (heap pages spread over the whole heap) each time, as a task switch does
+static uint32_t bench_address_space_switch(paging_dir *task, paging_dir *kernel)
+{
+  uint32_t stride = (uint32_t)(kheap_get_end() - (void *)NUTSOS_HEAP_ADDRESS) / BENCH_SWITCH_PAGES;
+  stride -= stride % PAGING_PAGE_SIZE;
+
+  volatile uint32_t sum = 0;
+  uint64_t start = cpu_read_tsc();
+  for (int i = 0; i < BENCH_SWITCH_ROUNDS; i++) {
+    paging_switch(task);
+    for (int p = 0; p < BENCH_SWITCH_PAGES; p++) {
+      sum += *(volatile uint32_t *)(NUTSOS_HEAP_ADDRESS + p * stride);
+    }
+
+    paging_switch(kernel);
+    for (int p = 0; p < BENCH_SWITCH_PAGES; p++) {
+      sum += *(volatile uint32_t *)(NUTSOS_HEAP_ADDRESS + p * stride);
+    }
+  }
+  uint32_t cycles = (uint32_t)(cpu_read_tsc() - start);
+
+  return cycles / BENCH_SWITCH_ROUNDS;
+}
+
+// Compare address space switches with the kernel mappings flushed on every CR3 reload
+// (CR4.PGE off, the global bits are ignored) and kept in the TLB (CR4.PGE on)
+static void bench_global_pages()
+{
+  struct cpu_id id;
+  cpu_cpuid(1, &id);
+  if (!(id.edx & CPU_FEATURE_EDX_PGE)) {
+    print("address space switch: no global pages on this CPU\n");
+    return;
+  }
+
+  struct paging_chunk *kernel_chunk = kernel_get_paging_chunk();
+  struct paging_chunk *task_chunk = paging_chunk_new_shared(kernel_chunk);
+  if (!task_chunk) {
+    print("bench: unable to create the task paging chunk\n");
+    return;
+  }
+
+  paging_dir *kernel = paging_chunk_get_directory(kernel_chunk);
+  paging_dir *task = paging_chunk_get_directory(task_chunk);
+
+  uint32_t cr4 = cpu_read_cr4();
+  cpu_write_cr4(cr4 & ~CPU_CR4_PGE);
+  uint32_t without = bench_address_space_switch(task, kernel);
+  cpu_write_cr4(cr4 | CPU_CR4_PGE);
+  uint32_t with = bench_address_space_switch(task, kernel);
+  cpu_write_cr4(cr4);
+
+  printf("address space switch and back: %u cycles without global pages, %u with\n", without, with);
+
+  paging_switch(kernel);
+  paging_chunk_free(task_chunk);
+}
+
+void bench_run()
+{
+  bench_heap();
+  bench_memory();
+  bench_string();
+  bench_global_pages();
+}
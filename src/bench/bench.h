@@ -0,0 +1,7 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Run the kernel micro-benchmarks and print their results (see NUTSOS_BENCHMARKS in config.h)
+void bench_run();
+
+#endif
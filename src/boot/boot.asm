@@ -6,13 +6,20 @@ BITS 16 ; i386 starts in real mode, which is 16bit
 CODE_SEG equ gdt_code - gdt_start ; 0x08
 DATA_SEG equ gdt_data - gdt_start ; 0x10
 
+; The BIOS memory map is stored in free conventional memory and handed to the kernel in esi:
+; a dword with the number of entries followed by the 24-byte E820 entries
+E820_MAP_ADDRESS equ 0x0500
+E820_ENTRY_SIZE equ 24
+E820_MAX_ENTRIES equ 64
+E820_SIGNATURE equ 0x534D4150 ; 'SMAP'
+
 ; boot sector descriptor - see https://wiki.osdev.org/FAT#Boot_Record
 jmp short start ; Jump pass the boot sector descriptor
 nop
 OEMIdentifier           db 'MSWIN4.1' ; OEM identifier. The first 8 Bytes (3 - 10) is the version of DOS being used. 
 BytesPerSector          dw 0x200 ; The number of Bytes per sector (remember, all numbers are in the little-endian format).
 SectorsPerCluster       db 0x80 ; Number of sectors per cluster.
-ReservedSectors         dw 200 ; Number of reserved sectors. The boot record sectors are included in this value.
+ReservedSectors         dw 8392 ; Number of reserved sectors. The boot record sectors are included in this value. Boot sector and kernel (200), then the swap area (NUTSOS_SWAP_SIZE_BYTES in config.h, 8192)
 FATCopies               db 0x02 ; Number of File Allocation Tables (FAT's) on the storage media.
 RootDirEntries          dw 0x40 ; Number of directory entries (must be set so that the root directory occupies entire sectors).
 NumSectors              dw 0x00 ; The total sectors in the logical volume. If this value is 0, it means there are more than 65535 sectors in the volume, and the actual count is stored in the Large Sector Count entry at 0x20.
@@ -43,6 +50,33 @@ setup_segments:
     mov sp, 0x7c00 ; setup the stack
     sti ; Enables Interrupts
 
+; Ask the BIOS for the memory map (INT 0x15, EAX=0xE820), one entry per call
+; see https://wiki.osdev.org/Detecting_Memory_(x86)#BIOS_Function:_INT_0x15.2C_EAX_.3D_0xE820
+.detect_memory:
+    mov di, E820_MAP_ADDRESS + 4
+    xor ebx, ebx ; continuation value, 0 to start from the beginning
+    xor bp, bp ; number of entries stored
+.next_entry:
+    mov eax, 0xE820
+    mov ecx, E820_ENTRY_SIZE
+    mov edx, E820_SIGNATURE
+    mov dword [es:di + 20], 1 ; mark the entry valid in case the BIOS doesn't fill the ACPI attributes
+    int 0x15
+    jc .memory_detected ; carry set means unsupported or end of the list
+    cmp eax, E820_SIGNATURE
+    jne .memory_detected
+    jcxz .skip_entry ; ignore empty entries
+    inc bp
+    add di, E820_ENTRY_SIZE
+.skip_entry:
+    test ebx, ebx ; ebx is 0 after the last entry
+    jz .memory_detected
+    cmp bp, E820_MAX_ENTRIES
+    jb .next_entry
+.memory_detected:
+    movzx eax, bp
+    mov [E820_MAP_ADDRESS], eax
+
 .load_protected:
     cli
     lgdt[gdt_descriptor] ; load the GDT descriptor
@@ -87,9 +121,10 @@ gdt_descriptor:
 [BITS 32] ; switch to 32bit mode
 load32:
     mov eax, 1
-    mov ecx, 100 
+    mov ecx, KERNEL_SECTORS ; set by the Makefile
     mov edi, 0x00100000
     call ata_lba_read ; read the kernel from disk
+    mov esi, E820_MAP_ADDRESS ; hand the memory map over to the kernel
     jmp CODE_SEG:0x00100000 ; jump to the kernel first instruction
 
 ; load data from disk to ram
@@ -4,28 +4,102 @@
 
 #define NUTSOS_TOTAL_INTERRUPTS                    512
 
-// 512MB heap size
-#define NUTSOS_HEAP_SIZE_BYTES                     512 * (1024 * 1024)
+// The kernel lives in the top of every address space, where the RAM is mapped at NUTSOS_KERNEL_VIRTUAL_BASE
+// onwards (physical address + NUTSOS_KERNEL_VIRTUAL_BASE). Only the RAM that fits there is used.
+// Keep in sync with kernel.asm and linker.ld
+#define NUTSOS_KERNEL_VIRTUAL_BASE                 0xC0000000
+#define NUTSOS_KERNEL_DIRECT_MAP_SIZE              0x3FC00000
+// The last 4 MiB of the address space are a window where the kernel maps the frames that are not in
+// its mapping of the RAM, one per slot (see paging_kmap)
+#define NUTSOS_KERNEL_KMAP_ADDRESS                 0xFFC00000
+#define NUTSOS_KERNEL_KMAP_SLOTS                   2
+#define NUTSOS_KERNEL_STACK_ADDRESS                (NUTSOS_KERNEL_VIRTUAL_BASE + 0x00600000)
+
+// The heap starts at NUTSOS_HEAP_PHYSICAL_ADDRESS and takes 1/NUTSOS_HEAP_RAM_SHARE of the usable RAM
+// reported by the BIOS, within the min/max bounds below. Its table lives in conventional memory
+// right after the boot sector (enough room for the table of the largest heap).
+#define NUTSOS_HEAP_RAM_SHARE                      4
+#define NUTSOS_HEAP_MIN_SIZE_BYTES                 (4 * 1024 * 1024)
+#define NUTSOS_HEAP_MAX_SIZE_BYTES                 (256 * 1024 * 1024)
 #define NUTSOS_HEAP_BLOCK_SIZE                     4096
-#define NUTSOS_HEAP_ADDRESS                        0x01000000
-#define NUTSOS_HEAP_TABLE_ADDRESS                  0x00007E00
+#define NUTSOS_HEAP_PHYSICAL_ADDRESS               0x01000000
+#define NUTSOS_HEAP_ADDRESS                        (NUTSOS_KERNEL_VIRTUAL_BASE + NUTSOS_HEAP_PHYSICAL_ADDRESS)
+#define NUTSOS_HEAP_TABLE_ADDRESS                  (NUTSOS_KERNEL_VIRTUAL_BASE + 0x00007E00)
+
+// Kernel heap allocator, chosen at build time:
+// - NUTSOS_HEAP_BACKEND_BLOCK: first-fit over the block table (heap.c)
+// - NUTSOS_HEAP_BACKEND_BUDDY: binary buddy allocator with coalescing (buddy.c)
+#define NUTSOS_HEAP_BACKEND_BLOCK                  0
+#define NUTSOS_HEAP_BACKEND_BUDDY                  1
+#ifndef NUTSOS_HEAP_BACKEND
+#define NUTSOS_HEAP_BACKEND                        NUTSOS_HEAP_BACKEND_BLOCK
+#endif
+
+// Allocations up to NUTSOS_HEAP_SLAB_MAX_SIZE bytes are served by power-of-two
+// size classes carved from heap blocks rather than by whole blocks
+#define NUTSOS_HEAP_SLAB_MIN_SIZE                  16
+#define NUTSOS_HEAP_SLAB_MAX_SIZE                  1024
+
+// Page frames (page tables and user memory) come from all the usable RAM past the end of the heap
+#define NUTSOS_FRAME_SIZE                          4096
+// Frames (and heap blocks) zeroed ahead of time while the kernel is idle, so that page tables and
+// user memory can be handed out zero-filled without paying for it at process creation
+#define NUTSOS_FRAME_ZERO_POOL_SIZE                1024
+#define NUTSOS_HEAP_ZERO_POOL_SIZE                 256
+
+// Uncomment to record the caller, size and timestamp of every kernel heap allocation and free.
+// Up to NUTSOS_HEAP_PROFILE_CALLSITES callers and NUTSOS_HEAP_PROFILE_ALLOCATIONS live allocations
+// are tracked (both need to be powers of two), see kheap_print_fragmentation
+// #define NUTSOS_HEAP_PROFILING
+#define NUTSOS_HEAP_PROFILE_CALLSITES              256
+#define NUTSOS_HEAP_PROFILE_ALLOCATIONS            8192
 
 // Disk
 #define NUTSOS_SECTOR_SIZE                         512
+// Sectors kept in the buffer cache, hashed in NUTSOS_DISK_CACHE_BUCKETS chains (a power of two).
+// Reads of more than NUTSOS_DISK_CACHE_MAX_READ_SECTORS sectors (file data, swap) go straight to the
+// disk so that they don't push the file system metadata out of the cache
+#define NUTSOS_DISK_CACHE_SECTORS                  512
+#define NUTSOS_DISK_CACHE_BUCKETS                  128
+#define NUTSOS_DISK_CACHE_MAX_READ_SECTORS         4
 #define NUTSOS_MAX_PATH                            256
 
+// Swap: once the frames run out, cold user pages are written to NUTSOS_SWAP_SIZE_BYTES of disk from sector
+// NUTSOS_SWAP_START_SECTOR on. The area is part of the reserved sectors of the FAT16 volume, keep in sync
+// with ReservedSectors in boot.asm. A size of 0 turns swapping off
+#define NUTSOS_SWAP_START_SECTOR                   200
+#define NUTSOS_SWAP_SIZE_BYTES                     (4 * 1024 * 1024)
+
 // FS
 #define NUTSOS_MAX_FILESYSTEMS                     16
 #define NUTSOS_MAX_FILE_DESCRIPTORS                1024
 
 // Processes
 #define NUTSOS_MAX_PROCESSES                       1024
+// Ranges of user memory a process can declare, their pages are only backed by a frame when first touched
+#define NUTSOS_MAX_PROCESS_REGIONS                 16
+
+// Uncomment to switch to PAE paging (needs a CPU supporting it): page table entries become 64 bits wide,
+// user pages can come from the RAM above NUTSOS_KERNEL_DIRECT_MAP_SIZE (up to 64 GiB) and the user data
+// is mapped no-execute when the CPU supports it. Picked by the boot trampoline as well, see paging_boot_pae
+// #define NUTSOS_PAGING_PAE
+
+// Tasks only map their own pages below NUTSOS_USER_SPACE_END, the kernel mappings past it are the
+// same in every address space (and marked global, see paging_chunk_new)
+#define NUTSOS_USER_SPACE_END                      NUTSOS_KERNEL_VIRTUAL_BASE
 
 #define NUTSOS_PROGRAM_VIRTUAL_ADDRESS             0x00400000
-#define NUTSOS_USER_PROGRAM_STACK_SIZE             1024 * 16
+// The stack is reserved up to NUTSOS_USER_PROGRAM_STACK_MAX_SIZE, its pages are only backed by frames as it
+// grows into them. The page below the reservation is a guard that is never mapped, so that overrunning the
+// stack kills the process rather than running into other memory
+#define NUTSOS_USER_PROGRAM_STACK_MAX_SIZE         (1024 * 1024)
 #define NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START 0x003FF000
 #define NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END \
-  (NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START - NUTSOS_USER_PROGRAM_STACK_SIZE) // stack grows downwards
+  (NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START - NUTSOS_USER_PROGRAM_STACK_MAX_SIZE) // stack grows downwards
+#define NUTSOS_PROGRAM_VIRTUAL_STACK_GUARD_ADDRESS (NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END - 4096)
+
+// Uncomment to run the kernel micro-benchmarks at boot, before the first process is started
+// #define NUTSOS_BENCHMARKS
 
 // HID IO
 #define NUTSOS_KEYBOARD_BUFFER_SIZE 1024
@@ -0,0 +1,93 @@
+[BITS 32]
+
+section .asm
+
+global cpu_read_tsc
+global cpu_cpuid
+global cpu_enable_sse
+global cpu_read_cr4
+global cpu_write_cr4
+global cpu_read_msr
+global cpu_write_msr
+
+; uint64_t cpu_read_tsc()
+; Reads the time stamp counter, rdtsc already leaves it in edx:eax as a cdecl uint64_t return value
+cpu_read_tsc:
+    rdtsc
+    ret
+
+; void cpu_cpuid(uint32_t leaf, struct cpu_id *out)
+; Runs cpuid for leaf and stores eax, ebx, ecx and edx in out (ebx is callee-saved in cdecl)
+cpu_cpuid:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push edi
+
+    mov eax, [ebp+8]
+    xor ecx, ecx
+    cpuid
+    mov edi, [ebp+12]
+    mov [edi], eax
+    mov [edi+4], ebx
+    mov [edi+8], ecx
+    mov [edi+12], edx
+
+    pop edi
+    pop ebx
+    pop ebp
+    ret
+
+; void cpu_enable_sse()
+; SSE instructions raise #UD until the OS says it saves their state: clear CR0.EM (no x87 emulation),
+; set CR0.MP and set CR4.OSFXSR and CR4.OSXMMEXCPT
+cpu_enable_sse:
+    push ebp
+    mov ebp, esp
+
+    mov eax, cr0
+    and eax, ~(1 << 2)
+    or eax, 1 << 1
+    mov cr0, eax
+
+    mov eax, cr4
+    or eax, (1 << 9) | (1 << 10)
+    mov cr4, eax
+
+    pop ebp
+    ret
+
+; uint32_t cpu_read_cr4()
+cpu_read_cr4:
+    mov eax, cr4
+    ret
+
+; void cpu_write_cr4(uint32_t value)
+cpu_write_cr4:
+    push ebp
+    mov ebp, esp
+    mov eax, [ebp+8]
+    mov cr4, eax
+    pop ebp
+    ret
+
+; uint64_t cpu_read_msr(uint32_t msr)
+; rdmsr leaves the register in edx:eax, already the cdecl uint64_t return value
+cpu_read_msr:
+    push ebp
+    mov ebp, esp
+    mov ecx, [ebp+8]
+    rdmsr
+    pop ebp
+    ret
+
+; void cpu_write_msr(uint32_t msr, uint64_t value)
+cpu_write_msr:
+    push ebp
+    mov ebp, esp
+    mov ecx, [ebp+8]
+    mov eax, [ebp+12]
+    mov edx, [ebp+16]
+    wrmsr
+    pop ebp
+    ret
@@ -0,0 +1,53 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// CPUID leaf 1 feature bits
+#define CPU_FEATURE_EDX_PSE  (1 << 3)
+#define CPU_FEATURE_EDX_PAE  (1 << 6)
+#define CPU_FEATURE_EDX_PGE  (1 << 13)
+#define CPU_FEATURE_EDX_SSE2 (1 << 26)
+
+// CPUID leaf CPU_EXTENDED_LEAVES returns the highest extended leaf in eax,
+// leaf CPU_EXTENDED_FEATURES the extended feature bits
+#define CPU_EXTENDED_LEAVES         0x80000000
+#define CPU_EXTENDED_FEATURES       0x80000001
+#define CPU_EXTENDED_FEATURE_EDX_NX (1 << 20)
+
+// CR4 bits
+#define CPU_CR4_PSE          (1 << 4)
+#define CPU_CR4_PAE          (1 << 5)
+#define CPU_CR4_PGE          (1 << 7)
+
+// Extended feature enable register and its bits
+#define CPU_MSR_EFER         0xC0000080
+#define CPU_EFER_NXE         (1 << 11)
+
+struct cpu_id {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+};
+
+// Defined in cpu.asm
+// Returns the number of cycles since reset
+uint64_t cpu_read_tsc();
+
+// Run the CPUID instruction for leaf and store the resulting registers in out
+void cpu_cpuid(uint32_t leaf, struct cpu_id *out);
+
+// Allow the use of SSE instructions (the kernel doesn't save the SSE state on task switches,
+// code using xmm registers has to save and restore them itself)
+void cpu_enable_sse();
+
+// Read and write the CR4 control register
+uint32_t cpu_read_cr4();
+void cpu_write_cr4(uint32_t value);
+
+// Read and write a model specific register
+uint64_t cpu_read_msr(uint32_t msr);
+void cpu_write_msr(uint32_t msr, uint64_t value);
+
+#endif
@@ -0,0 +1,173 @@
+#include "cache.h"
+#include "config.h"
+#include "disk.h"
+#include "error.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+
+struct disk_cache_entry {
+  // The sector held by the entry, disk is NULL while the entry is unused
+  struct disk *disk;
+  unsigned int lba;
+
+  // Next entry of the same hash bucket
+  struct disk_cache_entry *next;
+
+  // Neighbours in the LRU list
+  struct disk_cache_entry *newer;
+  struct disk_cache_entry *older;
+
+  char data[NUTSOS_SECTOR_SIZE];
+};
+
+static struct disk_cache_entry *disk_cache_entries = 0;
+static struct disk_cache_entry *disk_cache_buckets[NUTSOS_DISK_CACHE_BUCKETS];
+
+// Both ends of the LRU list, unused entries are kept at the oldest end
+static struct disk_cache_entry *disk_cache_newest = 0;
+static struct disk_cache_entry *disk_cache_oldest = 0;
+
+static struct disk_cache_stats disk_cache_stats;
+
+static struct disk_cache_entry **disk_cache_get_bucket(struct disk *disk, unsigned int lba)
+{
+  return &disk_cache_buckets[(lba ^ (disk->id << 16)) & (NUTSOS_DISK_CACHE_BUCKETS - 1)];
+}
+
+static struct disk_cache_entry *disk_cache_find(struct disk *disk, unsigned int lba)
+{
+  struct disk_cache_entry *entry = *disk_cache_get_bucket(disk, lba);
+  while (entry && (entry->disk != disk || entry->lba != lba)) {
+    entry = entry->next;
+  }
+
+  return entry;
+}
+
+static void disk_cache_unlink(struct disk_cache_entry *entry)
+{
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    disk_cache_newest = entry->older;
+  }
+
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    disk_cache_oldest = entry->newer;
+  }
+}
+
+static void disk_cache_push_newest(struct disk_cache_entry *entry)
+{
+  entry->newer = 0;
+  entry->older = disk_cache_newest;
+  if (disk_cache_newest) {
+    disk_cache_newest->newer = entry;
+  } else {
+    disk_cache_oldest = entry;
+  }
+  disk_cache_newest = entry;
+}
+
+static void disk_cache_push_oldest(struct disk_cache_entry *entry)
+{
+  entry->older = 0;
+  entry->newer = disk_cache_oldest;
+  if (disk_cache_oldest) {
+    disk_cache_oldest->older = entry;
+  } else {
+    disk_cache_newest = entry;
+  }
+  disk_cache_oldest = entry;
+}
+
+// Take entry out of its hash bucket, it's unused afterwards
+static void disk_cache_remove(struct disk_cache_entry *entry)
+{
+  struct disk_cache_entry **link = disk_cache_get_bucket(entry->disk, entry->lba);
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+
+  *link = entry->next;
+  entry->next = 0;
+  entry->disk = 0;
+}
+
+int disk_cache_init()
+{
+  disk_cache_entries = kzalloc(NUTSOS_DISK_CACHE_SECTORS * sizeof(struct disk_cache_entry));
+  if (!disk_cache_entries) {
+    return -ENOMEM;
+  }
+
+  for (int i = 0; i < NUTSOS_DISK_CACHE_SECTORS; i++) {
+    disk_cache_push_oldest(&disk_cache_entries[i]);
+  }
+
+  return 0;
+}
+
+bool disk_cache_get(struct disk *disk, unsigned int lba, void *out)
+{
+  struct disk_cache_entry *entry = disk_cache_entries ? disk_cache_find(disk, lba) : 0;
+  if (!entry) {
+    disk_cache_stats.misses++;
+    return false;
+  }
+
+  disk_cache_stats.hits++;
+  memcpy(out, entry->data, NUTSOS_SECTOR_SIZE);
+  disk_cache_unlink(entry);
+  disk_cache_push_newest(entry);
+  return true;
+}
+
+void disk_cache_put(struct disk *disk, unsigned int lba, const void *data)
+{
+  if (!disk_cache_entries) {
+    return;
+  }
+
+  // Reuse the least recently used entry if the sector is not there yet
+  struct disk_cache_entry *entry = disk_cache_find(disk, lba);
+  if (!entry) {
+    entry = disk_cache_oldest;
+    if (entry->disk) {
+      disk_cache_remove(entry);
+    }
+
+    struct disk_cache_entry **bucket = disk_cache_get_bucket(disk, lba);
+    entry->disk = disk;
+    entry->lba = lba;
+    entry->next = *bucket;
+    *bucket = entry;
+  }
+
+  memcpy(entry->data, data, NUTSOS_SECTOR_SIZE);
+  disk_cache_unlink(entry);
+  disk_cache_push_newest(entry);
+}
+
+void disk_cache_invalidate(struct disk *disk, unsigned int lba, int total)
+{
+  if (!disk_cache_entries) {
+    return;
+  }
+
+  for (int i = 0; i < total; i++) {
+    struct disk_cache_entry *entry = disk_cache_find(disk, lba + i);
+    if (entry) {
+      disk_cache_remove(entry);
+      disk_cache_unlink(entry);
+      disk_cache_push_oldest(entry);
+    }
+  }
+}
+
+void disk_cache_get_stats(struct disk_cache_stats *stats)
+{
+  *stats = disk_cache_stats;
+}
@@ -0,0 +1,35 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Buffer cache of disk sectors, keyed by (disk, lba).
+// Up to NUTSOS_DISK_CACHE_SECTORS sectors are kept in a hash table of NUTSOS_DISK_CACHE_BUCKETS chains,
+// when it's full the least recently used one makes room for the new one. The cache only holds clean
+// copies of the disk content: writes must invalidate the sectors they change
+
+struct disk;
+
+struct disk_cache_stats {
+  // Sectors found in the cache and not found
+  uint32_t hits;
+  uint32_t misses;
+};
+
+// Allocate the cache, if it can't be done nothing is ever cached
+int disk_cache_init();
+
+// Copy sector lba of disk to out if it's cached, returns false otherwise
+bool disk_cache_get(struct disk *disk, unsigned int lba, void *out);
+
+// Cache data (NUTSOS_SECTOR_SIZE bytes) as the content of sector lba of disk
+void disk_cache_put(struct disk *disk, unsigned int lba, const void *data);
+
+// Drop total sectors of disk from lba on from the cache
+void disk_cache_invalidate(struct disk *disk, unsigned int lba, int total);
+
+// Fill stats with the hits and misses so far
+void disk_cache_get_stats(struct disk_cache_stats *stats);
+
+#endif
@@ -1,13 +1,15 @@
 #include "disk/disk.h"
 #include "config.h"
 #include "disk.h"
+#include "cache.h"
 #include "error.h"
 #include "io/io.h"
 #include "memory/memory.h"
 
 struct disk disk;
 
-// Similar to read_lba in boot.asm, this C function reads a sector from disk
+// Similar to read_lba in boot.asm, this C function reads total sectors (up to DISK_MAX_SECTORS_PER_COMMAND)
+// from disk with a single command. buf can't fault while the sectors are copied
 // See read in LBA mode: https://wiki.osdev.org/ATA_read/write_sectors
 int disk_read_sector(int lba, int total, void *buf)
 {
@@ -26,18 +28,76 @@ int disk_read_sector(int lba, int total, void *buf)
       c = insb(0x1F7);
     }
 
-    // Copy from hard disk to memory
+    // Copy the whole sector from hard disk to memory
+    insw_rep(0x1F0, ptr, 256);
+    ptr += 256;
+  }
+  return 0;
+}
+
+// Poll the status register until the drive is not busy any more
+// Returns the status, or -EIO if the drive reports an error (ERR) or a fault (DF)
+static int disk_wait_not_busy()
+{
+  unsigned char status = insb(0x1F7);
+  while (status & 0x80) {
+    status = insb(0x1F7);
+  }
+
+  if (status & 0x21) {
+    return -EIO;
+  }
+
+  return status;
+}
+
+// Writes total sectors from buf starting at lba, then flushes the write cache of the drive
+// See write in LBA mode: https://wiki.osdev.org/ATA_PIO_Mode#28_bit_PIO
+static int disk_write_sector(int lba, int total, void *buf)
+{
+  outb(0x1F6, (lba >> 24) | 0xE0);
+  outb(0x1F2, total);
+  outb(0x1F3, (unsigned char)(lba & 0xff));
+  outb(0x1F4, (unsigned char)(lba >> 8));
+  outb(0x1F5, (unsigned char)(lba >> 16));
+  outb(0x1F7, 0x30);
+
+  unsigned short *ptr = (unsigned short *)buf;
+  for (int b = 0; b < total; b++) {
+    // Wait for the drive to ask for the data
+    int status = disk_wait_not_busy();
+    if (ISERR(status)) {
+      return status;
+    }
+
+    if (!(status & 0x08)) {
+      return -EIO;
+    }
+
+    // Copy from memory to hard disk
     for (int i = 0; i < 256; i++) {
-      *ptr = insw(0x1F0);
+      outw(0x1F0, *ptr);
       ptr++;
     }
   }
-  return 0;
+
+  // The last sector must be written before the cache is flushed
+  int res = disk_wait_not_busy();
+  if (ISERR(res)) {
+    return res;
+  }
+
+  outb(0x1F7, 0xE7);
+  res = disk_wait_not_busy();
+  return ISERR(res) ? res : 0;
 }
 
 // No search, just statically define one disk
 void disk_search_and_init()
 {
+  // Nothing is cached if the cache can't be allocated, the disk still works
+  disk_cache_init();
+
   memset(&disk, 0, sizeof(disk));
   disk.type = NUTSOS_DISK_TYPE_REAL;
   disk.id = 0; // TODO: support multiple disks
@@ -54,11 +114,62 @@ struct disk *disk_get(int index)
   return &disk;
 }
 
+// Read total sectors from lba on straight from the disk, the bigger reads are split in as few commands as possible
+static int disk_read_uncached(struct disk *idisk, unsigned int lba, int total, void *buf)
+{
+  while (total > 0) {
+    int count = total < DISK_MAX_SECTORS_PER_COMMAND ? total : DISK_MAX_SECTORS_PER_COMMAND;
+    int res = disk_read_sector(lba, count, buf);
+    if (res < 0) {
+      return res;
+    }
+
+    lba += count;
+    total -= count;
+    buf += count * idisk->sector_size;
+  }
+
+  return 0;
+}
+
 int disk_read_block(struct disk *idisk, unsigned int lba, int total, void *buf)
 {
   if (idisk != &disk) {
     return -EIO;
   }
 
-  return disk_read_sector(lba, total, buf);
+  if (total > NUTSOS_DISK_CACHE_MAX_READ_SECTORS) {
+    return disk_read_uncached(idisk, lba, total, buf);
+  }
+
+  // Serve the cached sectors, from the first one missing on everything is read with a single command and cached
+  int i = 0;
+  while (i < total && disk_cache_get(idisk, lba + i, buf + (i * idisk->sector_size))) {
+    i++;
+  }
+
+  if (i == total) {
+    return 0;
+  }
+
+  int res = disk_read_uncached(idisk, lba + i, total - i, buf + (i * idisk->sector_size));
+  if (res < 0) {
+    return res;
+  }
+
+  for (; i < total; i++) {
+    disk_cache_put(idisk, lba + i, buf + (i * idisk->sector_size));
+  }
+
+  return 0;
+}
+
+int disk_write_block(struct disk *idisk, unsigned int lba, int total, void *buf)
+{
+  if (idisk != &disk) {
+    return -EIO;
+  }
+
+  disk_cache_invalidate(idisk, lba, total);
+  return disk_write_sector(lba, total, buf);
 }
\ No newline at end of file
@@ -8,6 +8,9 @@ typedef unsigned int disk_type_t;
 // Represents a real physical hard disk
 #define NUTSOS_DISK_TYPE_REAL 0
 
+// An ATA command transfers at most 256 sectors (a sector count of 0 stands for 256)
+#define DISK_MAX_SECTORS_PER_COMMAND 256
+
 struct disk {
   disk_type_t type;
   int sector_size;
@@ -20,6 +23,9 @@ struct disk {
 
 void disk_search_and_init();
 struct disk *disk_get(int index);
+// Read total sectors from lba on into buf, with as few commands as possible. Small reads (metadata) go
+// through the buffer cache, see NUTSOS_DISK_CACHE_MAX_READ_SECTORS
 int disk_read_block(struct disk *idisk, unsigned int lba, int total, void *buf);
+int disk_write_block(struct disk *idisk, unsigned int lba, int total, void *buf);
 
 #endif
\ No newline at end of file
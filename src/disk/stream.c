@@ -2,6 +2,7 @@
 #include "config.h"
 #include "error.h"
 #include "memory/heap/kheap.h"
+#include "memory/memory.h"
 
 struct disk_stream *diskstream_new(int disk_id)
 {
@@ -22,36 +23,38 @@ int diskstream_seek(struct disk_stream *stream, int pos)
   return 0;
 }
 
+// The whole sectors in the middle of the request are read straight into out with a single multi-sector
+// read, only the partial sectors at the head and the tail go through a bounce buffer
 int diskstream_read(struct disk_stream *stream, void *out, int total)
 {
   char buf[NUTSOS_SECTOR_SIZE];
 
-  int sector = stream->pos / NUTSOS_SECTOR_SIZE;
-  int offset = stream->pos % NUTSOS_SECTOR_SIZE;
-  int readable_in_sector = NUTSOS_SECTOR_SIZE - offset;
-  int remaining_to_read = total;
-  int total_to_read = remaining_to_read > readable_in_sector ? readable_in_sector : remaining_to_read;
   int res = EOK;
-  do {
-    res = disk_read_block(stream->disk, sector, 1, buf);
-    if (res < 0) {
-      break;
-    }
-
-    int read = total_to_read;
-    while (read-- > 0) {
-      *(char *)out++ = buf[offset++];
+  while (total > 0) {
+    int sector = stream->pos / NUTSOS_SECTOR_SIZE;
+    int offset = stream->pos % NUTSOS_SECTOR_SIZE;
+    int read = 0;
+    if (offset == 0 && total >= NUTSOS_SECTOR_SIZE) {
+      int sectors = total / NUTSOS_SECTOR_SIZE;
+      res = disk_read_block(stream->disk, sector, sectors, out);
+      if (res < 0) {
+        break;
+      }
+      read = sectors * NUTSOS_SECTOR_SIZE;
+    } else {
+      res = disk_read_block(stream->disk, sector, 1, buf);
+      if (res < 0) {
+        break;
+      }
+      read = NUTSOS_SECTOR_SIZE - offset < total ? NUTSOS_SECTOR_SIZE - offset : total;
+      memcpy(out, buf + offset, read);
     }
 
     // Adjust the stream
-    stream->pos += total_to_read;
-    sector = stream->pos / NUTSOS_SECTOR_SIZE;
-    offset = stream->pos % NUTSOS_SECTOR_SIZE;
-    readable_in_sector = NUTSOS_SECTOR_SIZE - offset;
-    remaining_to_read -= total_to_read;
-    total_to_read = remaining_to_read > readable_in_sector ? readable_in_sector : remaining_to_read;
-
-  } while (remaining_to_read > 0);
+    out += read;
+    stream->pos += read;
+    total -= read;
+  }
 
   return res;
 }
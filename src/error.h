@@ -9,6 +9,7 @@
 #define EINVALID    5
 #define EREADONLY   6
 #define ETAKEN      7
+#define EFAULT      8
 
 #define ISERR(v)    ((v) < 0)
 #define ERRTOPTR(e) ((void *)(e))
@@ -0,0 +1,120 @@
+#include "file_mapping.h"
+#include "file.h"
+#include "error.h"
+#include "memory/frame/frame.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "memory/paging/paging.h"
+#include "stdutil/string.h"
+
+// All the files mapped by at least one process
+static struct file_mapping *file_mappings = 0;
+
+struct file_mapping *file_mapping_get(const char *filename)
+{
+  for (struct file_mapping *mapping = file_mappings; mapping; mapping = mapping->next) {
+    if (strncmp(mapping->filename, filename, sizeof(mapping->filename)) == 0) {
+      mapping->refs++;
+      return mapping;
+    }
+  }
+
+  struct file_descriptor *fd = fopen(filename, "r");
+  if (!fd) {
+    return 0;
+  }
+
+  struct file_stat stat;
+  struct file_mapping *mapping = kzalloc(sizeof(struct file_mapping));
+  if (!mapping || fstat(fd->index, &stat) < 0) {
+    goto err;
+  }
+
+  mapping->page_count = (uint32_t)paging_align_address((void *)stat.filesize) / PAGING_PAGE_SIZE;
+  mapping->pages = kzalloc(mapping->page_count * sizeof(void *));
+  if (mapping->page_count && !mapping->pages) {
+    goto err;
+  }
+
+  strncpy(mapping->filename, filename, sizeof(mapping->filename) - 1);
+  mapping->fd = fd->index;
+  mapping->size = stat.filesize;
+  mapping->refs = 1;
+  mapping->next = file_mappings;
+  file_mappings = mapping;
+  return mapping;
+
+err:
+  if (mapping) {
+    kfree(mapping->pages);
+    kfree(mapping);
+  }
+  fclose(fd->index);
+  return 0;
+}
+
+void file_mapping_ref(struct file_mapping *mapping)
+{
+  mapping->refs++;
+}
+
+void file_mapping_put(struct file_mapping *mapping)
+{
+  if (--mapping->refs) {
+    return;
+  }
+
+  struct file_mapping **link = &file_mappings;
+  while (*link != mapping) {
+    link = &(*link)->next;
+  }
+  *link = mapping->next;
+
+  for (uint32_t i = 0; i < mapping->page_count; i++) {
+    if (mapping->pages[i]) {
+      frame_free(mapping->pages[i]);
+    }
+  }
+
+  fclose(mapping->fd);
+  kfree(mapping->pages);
+  kfree(mapping);
+}
+
+// Fill frame with the page of the file at offset
+static int file_mapping_read_page(struct file_mapping *mapping, uint32_t offset, void *frame)
+{
+  uint32_t total = mapping->size - offset < PAGING_PAGE_SIZE ? mapping->size - offset : PAGING_PAGE_SIZE;
+  memset(frame + total, 0x00, PAGING_PAGE_SIZE - total);
+  if (fseek(mapping->fd, offset, SEEK_SET) != EOK || fread(frame, total, 1, mapping->fd) != 1) {
+    return -EIO;
+  }
+
+  return 0;
+}
+
+void *file_mapping_get_page(struct file_mapping *mapping, uint32_t offset)
+{
+  // Past the end of the file there's nothing to share, every page is a fresh zero-filled one
+  uint32_t index = offset / PAGING_PAGE_SIZE;
+  if (index >= mapping->page_count) {
+    return frame_zalloc();
+  }
+
+  void *frame = mapping->pages[index];
+  if (!frame) {
+    frame = frame_alloc();
+    if (!frame) {
+      return 0;
+    }
+
+    if (file_mapping_read_page(mapping, offset, frame) < 0) {
+      frame_free(frame);
+      return 0;
+    }
+    mapping->pages[index] = frame;
+  }
+
+  frame_ref(frame);
+  return frame;
+}
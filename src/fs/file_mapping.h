@@ -0,0 +1,43 @@
+#ifndef FILE_MAPPING_H
+#define FILE_MAPPING_H
+
+#include "config.h"
+#include <stdint.h>
+
+// A file mapped in the address space of one or more processes (see process_map_file).
+// Every process mapping the same file shares one of these, along with the pages of the file read so far:
+// each page is read from the filesystem once, the first time any process touches it, and stays cached
+// until the last mapping of the file is gone.
+struct file_mapping {
+  char filename[NUTSOS_MAX_PATH];
+  int fd;
+
+  // Size of the file in bytes
+  uint32_t size;
+
+  // Mappings of the file (process regions) sharing this
+  int refs;
+
+  // Frames holding the pages of the file read so far, NULL for the ones never touched
+  void **pages;
+  uint32_t page_count;
+
+  struct file_mapping *next;
+};
+
+// Returns the mapping for filename, opening the file if it's not mapped by anyone yet.
+// The mapping has one more reference, returns NULL if the file can't be opened
+struct file_mapping *file_mapping_get(const char *filename);
+
+// Add a reference to a mapping
+void file_mapping_ref(struct file_mapping *mapping);
+
+// Drop a reference to a mapping, the file is closed and its cached pages released with the last one
+void file_mapping_put(struct file_mapping *mapping);
+
+// Returns the frame holding the page of the file at offset (PAGING_PAGE_SIZE aligned), reading it if needed.
+// Bytes past the end of the file are zero. The frame has one more reference for the caller (see frame_ref),
+// returns NULL if the page can't be read
+void *file_mapping_get_page(struct file_mapping *mapping, uint32_t offset);
+
+#endif
@@ -3,6 +3,7 @@ section .asm
 extern int21h_handler
 extern no_interrupt_handler
 extern isr80h_handler
+extern page_fault_handler
 
 global int21h
 global idt_load
@@ -10,6 +11,7 @@ global no_interrupt
 global enable_interrupts
 global disable_interrupts
 global isr80h_wrapper
+global page_fault_wrapper
 
 ; Enable interrupts
 enable_interrupts:
@@ -44,6 +46,20 @@ no_interrupt:
     popad
     iret
 
+; The cpu pushes an error code on top of the interrupt frame for page faults: pass it to
+; page_fault_handler along with the faulting address and drop it before returning
+page_fault_wrapper:
+    pushad
+    push dword [esp+32] ; error code, right above the general purpose registers
+    mov eax, cr2
+    push eax            ; address that caused the fault
+    call page_fault_handler
+    add esp, 8
+
+    popad
+    add esp, 4 ; pop the error code
+    iretd
+
 ; This function pushes the general registers into the interrupt frame and then call the handler
 ; It also deals with clearing up the stack after collecting the result from the handler function
 isr80h_wrapper:
@@ -5,6 +5,7 @@
 #include "isr80h/isr80h.h"
 #include "kernel.h"
 #include "memory/memory.h"
+#include "task/process.h"
 #include "task/task.h"
 #include "terminal/terminal.h"
 
@@ -13,6 +14,7 @@ extern void idt_load(struct idtr_desc *ptr);
 extern void int21h();
 extern void no_interrupt();
 extern void isr80h_wrapper();
+extern void page_fault_wrapper();
 
 __attribute__((aligned(0x10))) struct idt_desc idt_descriptors[NUTSOS_TOTAL_INTERRUPTS];
 struct idtr_desc idtr_descriptor;
@@ -36,18 +38,42 @@ void idt_zero()
   print("Divide by zero error\n");
 }
 
+// Handler for page faults (interrupt 14)
+// address: the address that caused the fault (CR2)
+// error: error code pushed by the cpu
+void page_fault_handler(void *address, uint32_t error)
+{
+  struct task *task = task_current();
+  if (task && process_page_fault(task->process, address, error) == 0) {
+    return;
+  }
+
+  // The kernel touching its own memory is a bug, only user memory can go missing
+  if (!task || (!(error & IDT_PAGE_FAULT_USER) && (uint32_t)address >= NUTSOS_USER_SPACE_END)) {
+    printf("Page fault at %x (error %x)\n", (uint32_t)address, error);
+    panic("Page fault in the kernel\n");
+  }
+
+  const char *reason = process_is_guard_page(task->process, address) ? "stack overflow" : "page fault";
+  printf("[K] Process %u killed: %s at %x (error %x)\n", task->process->id, reason, (uint32_t)address, error);
+  process_terminate(task->process);
+  task_next();
+}
+
 // Set a handler for an interrupt
 // interrupt_no:number of the interrupt to set
 // address: addres of the function handling the interrupt
-void idt_set(int interrupt_no, void *address)
+// ring: least privileged ring allowed to raise it with an int instruction (hardware interrupts and
+// CPU exceptions always go through)
+void idt_set(int interrupt_no, void *address, int ring)
 {
   struct idt_desc *desc = &idt_descriptors[interrupt_no];
   desc->offset_low = IDT_OFFSET_LOW(address);
   desc->selector = GDT_KERNEL_CODE_OFFSET;
   desc->unused = 0x00;
 
-  // 32bit interrupt, accessible from ring 3
-  desc->type_attr = IDT_ATTR_PRESENT | IDT_ATTR_INT32 | IDT_ATTR_RING(3);
+  // 32bit interrupt
+  desc->type_attr = IDT_ATTR_PRESENT | IDT_ATTR_INT32 | IDT_ATTR_RING(ring);
   desc->offset_high = IDT_OFFSET_HIGH(address);
 }
 
@@ -58,13 +84,16 @@ void idt_init()
   idtr_descriptor.limit = sizeof(idt_descriptors) - 1;
   idtr_descriptor.base = (uint32_t)idt_descriptors;
 
+  // Only the kernel calls can be raised from user mode: the exception handlers expect the frame
+  // pushed by the CPU (with an error code for some of them), not the one of an int instruction
   for (int i = 0; i < NUTSOS_TOTAL_INTERRUPTS; i++) {
-    idt_set(i, no_interrupt);
+    idt_set(i, no_interrupt, 0);
   }
 
-  idt_set(0x00, idt_zero);
-  idt_set(0x21, int21h);
-  idt_set(0x80, isr80h_wrapper);
+  idt_set(0x00, idt_zero, 0);
+  idt_set(0x0E, page_fault_wrapper, 0);
+  idt_set(0x21, int21h, 0);
+  idt_set(0x80, isr80h_wrapper, 3);
 
   // Load the interrupt descriptor table
   idt_load(&idtr_descriptor);
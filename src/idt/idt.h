@@ -23,6 +23,11 @@ struct idtr_desc {
 #define IDT_ATTR_TRA32     0b00001111
 #define IDT_ATTR_PRESENT   0b10000000
 
+// Bits of the error code pushed by the CPU on a page fault
+#define IDT_PAGE_FAULT_PRESENT 0b00000001 // The page was present, the access broke its protection
+#define IDT_PAGE_FAULT_WRITE   0b00000010 // The access was a write
+#define IDT_PAGE_FAULT_USER    0b00000100 // The access came from user mode
+
 // Represent the process state when an int is called
 struct interrupt_frame {
   uint32_t edi;
@@ -4,6 +4,7 @@ global insb
 global insw
 global outb
 global outw
+global insw_rep
 
 insb:
     push ebp
@@ -47,4 +48,21 @@ outw:
     out dx, ax
 
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+; void insw_rep(unsigned short port, void *buffer, int count)
+; Reads count words from port into buffer in one go with rep insw
+insw_rep:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edx, [ebp+8]
+    mov edi, [ebp+12]
+    mov ecx, [ebp+16]
+    cld
+    rep insw
+
+    pop edi
+    pop ebp
+    ret
@@ -3,6 +3,8 @@
 
 unsigned char insb(unsigned short port);
 unsigned short insw(unsigned short port);
+// Read count words from port into buffer
+void insw_rep(unsigned short port, void *buffer, int count);
 
 void outb(unsigned short port, unsigned char val);
 void outw(unsigned short port, unsigned short val);
@@ -56,4 +56,6 @@ void isr80h_register_commands()
 {
   isr80h_register_command(INT80H_COMMAND_SUM, isr80h_command_sum);
   isr80h_register_command(INT80H_COMMAND_PRINT, isr80h_command_print);
+  isr80h_register_command(INT80H_COMMAND_FORK, isr80h_command_fork);
+  isr80h_register_command(INT80H_COMMAND_MMAP, isr80h_command_mmap);
 }
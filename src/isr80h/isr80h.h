@@ -5,6 +5,8 @@ typedef enum
 {
   INT80H_COMMAND_SUM,
   INT80H_COMMAND_PRINT,
+  INT80H_COMMAND_FORK,
+  INT80H_COMMAND_MMAP,
   INT80H_COMMMAND_MAX
 } int80h_commands_t;
 
@@ -1,7 +1,48 @@
 #include "misc.h"
+#include "config.h"
+#include "error.h"
 #include "idt/idt.h"
+#include "memory/paging/paging.h"
+#include "stdutil/string.h"
+#include "task/process.h"
+#include "task/task.h"
 
 void *isr80h_command_sum(struct interrupt_frame *frame)
 {
   return (void *)10;
-}
\ No newline at end of file
+}
+
+void *isr80h_command_fork(struct interrupt_frame *frame)
+{
+  struct process *process = 0;
+  int res = process_fork(task_current()->process, &process);
+  if (ISERR(res)) {
+    return ERRTOPTR(res);
+  }
+
+  return (void *)(uint32_t)process->id;
+}
+
+void *isr80h_command_mmap(struct interrupt_frame *frame)
+{
+  const char *filename_ptr = task_current_get_stack_item(0);
+  uint32_t offset = (uint32_t)task_current_get_stack_item(1);
+  void *addr = task_current_get_stack_item(2);
+  uint32_t length = (uint32_t)task_current_get_stack_item(3);
+  uint32_t flags = (uint32_t)task_current_get_stack_item(4);
+  // Any other region flag is for the kernel only
+  if (flags & ~(PROCESS_REGION_WRITEABLE | PROCESS_REGION_SHARED)) {
+    return ERRTOPTR(-EINVARG);
+  }
+
+  if (!task_current_validate_pointer((void *)filename_ptr)) {
+    return ERRTOPTR(-EINVARG);
+  }
+
+  char filename[NUTSOS_MAX_PATH];
+  strncpy(filename, filename_ptr, sizeof(filename) - 1);
+  filename[sizeof(filename) - 1] = 0;
+
+  void *end = paging_align_address(addr + length);
+  return ERRTOPTR(process_map_file(task_current()->process, addr, end, flags, filename, offset));
+}
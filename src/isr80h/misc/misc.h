@@ -3,4 +3,11 @@
 
 struct interrupt_frame;
 void *isr80h_command_sum(struct interrupt_frame *frame);
+
+// Duplicate the current process, returns the id of the new process (0 in the new process itself)
+void *isr80h_command_fork(struct interrupt_frame *frame);
+
+// Map a file in the current process, the arguments on the stack are (from the top):
+// filename, offset in the file, address, length in bytes, PROCESS_REGION_* flags. Returns 0 or an error
+void *isr80h_command_mmap(struct interrupt_frame *frame);
 #endif
\ No newline at end of file
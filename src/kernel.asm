@@ -2,10 +2,17 @@
 
 global _start
 extern kmain
+extern paging_boot_pae
 
 CODE_SEG equ 0x08 ; see boot.asm - code segment was set up at offset 8
 DATA_SEG equ 0x10 ; and data at offset 10 of the gdt table
 
+; The kernel is linked at KERNEL_VIRTUAL_BASE + 1MB but loaded at 1MB: until paging is on, addresses
+; of symbols need KERNEL_VIRTUAL_BASE taken off (see NUTSOS_KERNEL_VIRTUAL_BASE in config.h)
+KERNEL_VIRTUAL_BASE equ 0xC0000000
+KERNEL_DIRECTORY_INDEX equ KERNEL_VIRTUAL_BASE >> 22
+LARGE_PAGE_FLAGS equ 0x83 ; present, writeable, 4MB page (2MB with PAE)
+
 _start:
     mov ax, DATA_SEG
     mov ds, ax ; set up all other segment to overlap with data
@@ -13,8 +20,6 @@ _start:
     mov fs, ax
     mov gs, ax
     mov ss, ax
-    mov ebp, 0x00200000
-    mov esp, ebp ; initialize the stack pointer to a decent value (2MB off)
 
     ; Enable the A20 line - necessary to address >= 1MB RAM
     ; see https://en.wikipedia.org/wiki/A20_line for more info
@@ -22,6 +27,77 @@ _start:
     or al, 2
     out 0x92, al
 
+    ; Boot trampoline: map the first 4MB where they are (we're running from there) and the RAM from
+    ; KERNEL_VIRTUAL_BASE on with large pages, then jump to the kernel half. kmain replaces these
+    ; mappings with the kernel paging chunk as soon as it can
+    mov edi, boot_page_directory - KERNEL_VIRTUAL_BASE
+    xor eax, eax
+    mov ecx, BOOT_TABLES_SIZE / 4
+    cld
+    rep stosd
+
+    ; The kernel picks the kind of tables at build time (NUTSOS_PAGING_PAE), it can't be changed
+    ; once paging is on
+    mov eax, [paging_boot_pae - KERNEL_VIRTUAL_BASE]
+    test eax, eax
+    jnz .pae
+
+    mov edi, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov dword [edi], LARGE_PAGE_FLAGS
+    add edi, KERNEL_DIRECTORY_INDEX * 4
+    mov eax, LARGE_PAGE_FLAGS
+    mov ecx, 1024 - KERNEL_DIRECTORY_INDEX
+.map_kernel_half:
+    stosd
+    add eax, 0x00400000
+    loop .map_kernel_half
+
+    ; Enable 4MB pages (CR4.PSE)
+    mov eax, cr4
+    or eax, 0x10
+    mov cr4, eax
+    mov eax, boot_page_directory - KERNEL_VIRTUAL_BASE
+    jmp .enable_paging
+
+.pae:
+    ; Same mappings with 2MB pages and 8 byte entries (their upper halves stay 0): boot_page_directory
+    ; is the first GB, boot_kernel_directory the one at KERNEL_VIRTUAL_BASE (the 4th of the pointer table)
+    mov edi, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov dword [edi], LARGE_PAGE_FLAGS
+    mov dword [edi+8], LARGE_PAGE_FLAGS + 0x00200000
+    mov edi, boot_kernel_directory - KERNEL_VIRTUAL_BASE
+    mov eax, LARGE_PAGE_FLAGS
+    mov ecx, 512
+.map_kernel_half_pae:
+    mov [edi], eax
+    add edi, 8
+    add eax, 0x00200000
+    loop .map_kernel_half_pae
+
+    ; Pointer table entries only take the present bit
+    mov edi, boot_pdpt - KERNEL_VIRTUAL_BASE
+    mov dword [edi], boot_page_directory - KERNEL_VIRTUAL_BASE + 1
+    mov dword [edi+(KERNEL_VIRTUAL_BASE >> 30)*8], boot_kernel_directory - KERNEL_VIRTUAL_BASE + 1
+
+    ; Enable PAE (CR4.PAE)
+    mov eax, cr4
+    or eax, 0x20
+    mov cr4, eax
+    mov eax, boot_pdpt - KERNEL_VIRTUAL_BASE
+
+.enable_paging:
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    mov eax, higher_half
+    jmp eax
+
+higher_half:
+    mov ebp, KERNEL_VIRTUAL_BASE + 0x00200000
+    mov esp, ebp ; initialize the stack pointer to a decent value (2MB off)
+
     ; Remap the master PIC
     ; In protected mode, the IRQs 0 to 7 conflict with the CPU exception which are reserved 
     ; by Intel up until 0x1F. (It was an IBM design mistake.) Consequently it is difficult 
@@ -38,7 +114,20 @@ _start:
     out 0x21, al ; set PIC mode to 8086/88 (MCS-80/85)
     ; End remap of the master PIC
 
-    ; jump onto C code
+    ; jump onto C code, passing along the memory map collected by the boot loader (esi, in the kernel half)
+    add esi, KERNEL_VIRTUAL_BASE
+    push esi
     call kmain
 
     jmp $ ; should never reach here but loop on the spot if kmain ever returns
+
+section .bss
+alignb 4096
+boot_page_directory:
+    resb 4096
+; PAE only
+boot_kernel_directory:
+    resb 4096
+boot_pdpt:
+    resb 32
+BOOT_TABLES_SIZE equ $ - boot_page_directory
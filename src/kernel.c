@@ -1,5 +1,7 @@
 #include "kernel.h"
+#include "bench/bench.h"
 #include "config.h"
+#include "disk/cache.h"
 #include "disk/disk.h"
 #include "disk/stream.h"
 #include "error.h"
@@ -8,9 +10,12 @@
 #include "idt/idt.h"
 #include "io/io.h"
 #include "isr80h/isr80h.h"
+#include "memory/e820/e820.h"
+#include "memory/frame/frame.h"
 #include "memory/heap/kheap.h"
 #include "memory/memory.h"
 #include "memory/paging/paging.h"
+#include "memory/swap/swap.h"
 #include "task/process.h"
 #include "task/task.h"
 #include "task/tss.h"
@@ -27,6 +32,11 @@ void panic(const char *msg)
   while (1) {}
 }
 
+struct paging_chunk *kernel_get_paging_chunk()
+{
+  return kernel_chunk;
+}
+
 void kprint(const char *msg) {
   print("[K] ");
   print(msg);
@@ -45,7 +55,7 @@ struct gdt gdt[GDT_SEGMENTS_COUNT] = {
      .limit = sizeof(tss) - 1,
      .type = GDT_TSS_PRIV(3) | GDT_TSS_PRES(1) | GDT_TSS_32BIT(1) | GDT_TSS_TSSLDT(1)}}; // TSS
 
-void kmain()
+void kmain(struct e820_map *memory_map)
 {
   terminal_initialize();
   kprint("Terminal initialized.\n");
@@ -59,9 +69,20 @@ void kmain()
   gdt_load(t, sizeof(gdt_raw));
   kprint(" done\n");
 
+  // Pick the memset/memcpy implementation for this CPU before anything starts using them
+  memory_init();
+
   // Initialize the heap
+  printf("[K] Memory: %u KB usable\n", e820_get_usable_total(memory_map) / 1024);
   kprint("Initializing kernel heap...");
-  kheap_init();
+  kheap_init(memory_map);
+  kprint(" done\n");
+
+  // Initialize the page frame allocator
+  kprint("Initializing page frame allocator...");
+  if (frame_init(memory_map, kheap_get_end()) < 0) {
+    panic("Failed to create the page frame pool\n");
+  }
   kprint(" done\n");
 
   // Initialize filesystems
@@ -74,6 +95,14 @@ void kmain()
   disk_search_and_init();
   kprint(" done\n");
 
+  // Swap user pages out to the first disk when the RAM runs out
+  kprint("Initializing swap...");
+  if (swap_init(disk_get(0)) < 0) {
+    kprint(" off\n");
+  } else {
+    kprint(" done\n");
+  }
+
   // Initialize the interrupt descriptor table
   kprint("Initializing interrupts...");
   idt_init();
@@ -83,7 +112,7 @@ void kmain()
   kprint("Initializing TSS...");
   memset(s, 0x00, sizeof(tss));
   tss.ss0 = GDT_KERNEL_DATA_OFFSET;
-  tss.esp0 = 0x00600000;
+  tss.esp0 = NUTSOS_KERNEL_STACK_ADDRESS;
 
   // Load the TSS
   tss_load(GDT_TSS_OFFSET);
@@ -91,9 +120,13 @@ void kmain()
 
   // Setup paging
   kprint("Setting up paging...");
-  kernel_chunk = paging_chunk_new(PAGING_TOTAL_DIR_ENTRIES,
-                                  PAGING_TOTAL_ENTRIES_PER_TABLE,
-                                  PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+  paging_init(e820_get_usable_limit(memory_map));
+  // The kernel half of the address space is shared by every task, keep it out of reach of user mode.
+  // This replaces the boot page directory set up by kernel.asm
+  kernel_chunk = paging_chunk_new(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT);
+  if (!kernel_chunk) {
+    panic("Not enough memory for the kernel page tables\n");
+  }
 
   // Switch to kernel paging chunk
   paging_switch(paging_chunk_get_directory(kernel_chunk));
@@ -107,6 +140,29 @@ void kmain()
   isr80h_register_commands();
   kprint(" done\n");
 
+#ifdef NUTSOS_BENCHMARKS
+  kprint("Running benchmarks...\n");
+  bench_run();
+#endif
+
+  // Nothing else to do until the first process starts, get memory zeroed ahead of time
+  kprint("Zeroing free memory...");
+  frame_zero_pool_refill(NUTSOS_FRAME_ZERO_POOL_SIZE);
+  kheap_zero_free_blocks(NUTSOS_HEAP_ZERO_POOL_SIZE);
+  kprint(" done\n");
+
+  struct frame_stats frames;
+  frame_get_stats(&frames);
+  printf("[K] Page frames: %u free (%u zeroed), %u used\n", frames.free, frames.zeroed, frames.used);
+
+  struct disk_cache_stats disk_cache;
+  disk_cache_get_stats(&disk_cache);
+  printf("[K] Disk cache: %u hits, %u misses\n", disk_cache.hits, disk_cache.misses);
+
+#ifdef NUTSOS_HEAP_PROFILING
+  kheap_print_fragmentation();
+#endif
+
   kprint("Starting first process...\n\n");
   struct process *process = NULL;
   int res = process_load("0:/bin/empty.bin", &process);
@@ -1,7 +1,14 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
-void kmain();
+struct e820_map;
+struct paging_chunk;
+
+// Kernel entry point, memory_map is collected by the boot loader
+void kmain(struct e820_map *memory_map);
 void panic(const char *msg);
 
+// Returns the kernel paging chunk, whose page tables are shared by all the tasks
+struct paging_chunk *kernel_get_paging_chunk();
+
 #endif
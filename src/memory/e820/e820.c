@@ -0,0 +1,90 @@
+#include "e820.h"
+#include "config.h"
+
+// Only the RAM mapped in the kernel half of the address space is used
+#define E820_ADDRESSABLE_END ((uint64_t)NUTSOS_KERNEL_DIRECT_MAP_SIZE)
+
+// Get the page aligned part of the entry at index within [from, to) if it's usable RAM
+static bool e820_get_range(struct e820_map *map, int index, uint64_t from, uint64_t to, uint64_t *start_out, uint64_t *end_out)
+{
+  struct e820_entry *entry = &map->entries[index];
+  if (entry->type != E820_TYPE_USABLE || entry->base >= to) {
+    return false;
+  }
+
+  uint64_t start = entry->base < from ? from : entry->base;
+  uint64_t end = entry->base + entry->length;
+  if (end > to) {
+    end = to;
+  }
+
+  // Only whole pages are usable
+  start = (start + NUTSOS_FRAME_SIZE - 1) & ~((uint64_t)NUTSOS_FRAME_SIZE - 1);
+  end = end & ~((uint64_t)NUTSOS_FRAME_SIZE - 1);
+  if (end <= start) {
+    return false;
+  }
+
+  *start_out = start;
+  *end_out = end;
+  return true;
+}
+
+bool e820_get_usable_range(struct e820_map *map, int index, uint32_t *start_out, uint32_t *end_out)
+{
+  uint64_t start = 0;
+  uint64_t end = 0;
+  if (!e820_get_range(map, index, 0, E820_ADDRESSABLE_END, &start, &end)) {
+    return false;
+  }
+
+  *start_out = (uint32_t)start;
+  *end_out = (uint32_t)end;
+  return true;
+}
+
+bool e820_get_high_range(struct e820_map *map, int index, uint64_t *start_out, uint64_t *end_out)
+{
+  return e820_get_range(map, index, E820_ADDRESSABLE_END, E820_PAE_END, start_out, end_out);
+}
+
+uint32_t e820_get_usable_end(struct e820_map *map, uint32_t addr)
+{
+  for (int i = 0; i < map->count; i++) {
+    uint32_t start = 0;
+    uint32_t end = 0;
+    if (e820_get_usable_range(map, i, &start, &end) && addr >= start && addr < end) {
+      return end;
+    }
+  }
+
+  return 0;
+}
+
+uint32_t e820_get_usable_total(struct e820_map *map)
+{
+  uint32_t total = 0;
+  for (int i = 0; i < map->count; i++) {
+    uint32_t start = 0;
+    uint32_t end = 0;
+    if (e820_get_usable_range(map, i, &start, &end)) {
+      total += end - start;
+    }
+  }
+
+  return total;
+}
+
+uint32_t e820_get_usable_limit(struct e820_map *map)
+{
+  uint32_t limit = 0;
+  for (int i = 0; i < map->count; i++) {
+    uint32_t start = 0;
+    uint32_t end = 0;
+    if (e820_get_usable_range(map, i, &start, &end) && end > limit) {
+      limit = end;
+    }
+  }
+
+  return limit;
+}
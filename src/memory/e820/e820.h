@@ -0,0 +1,43 @@
+#ifndef E820_H
+#define E820_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// BIOS memory map as collected by boot.asm (INT 0x15, EAX=0xE820). All the addresses are physical
+// see https://wiki.osdev.org/Detecting_Memory_(x86)
+
+#define E820_TYPE_USABLE 1
+
+// PAE page tables address 36 bits of physical memory
+#define E820_PAE_END     (1ULL << 36)
+
+struct e820_entry {
+  uint64_t base;
+  uint64_t length;
+  uint32_t type;
+  uint32_t acpi;
+} __attribute__((packed));
+
+struct e820_map {
+  uint32_t count;
+  struct e820_entry entries[];
+} __attribute__((packed));
+
+// Get the page aligned [start, end) range of the entry at index if it's usable RAM the kernel maps (below NUTSOS_KERNEL_DIRECT_MAP_SIZE)
+bool e820_get_usable_range(struct e820_map *map, int index, uint32_t *start_out, uint32_t *end_out);
+
+// Get the page aligned [start, end) range of the entry at index if it's usable RAM above NUTSOS_KERNEL_DIRECT_MAP_SIZE,
+// up to E820_PAE_END (the kernel can only reach it with PAE, see paging_kmap)
+bool e820_get_high_range(struct e820_map *map, int index, uint64_t *start_out, uint64_t *end_out);
+
+// Returns the end of the usable region containing addr, or 0 if addr is not usable RAM
+uint32_t e820_get_usable_end(struct e820_map *map, uint32_t addr);
+
+// Returns the end of the highest usable region below NUTSOS_KERNEL_DIRECT_MAP_SIZE
+uint32_t e820_get_usable_limit(struct e820_map *map);
+
+// Returns the amount of usable RAM below NUTSOS_KERNEL_DIRECT_MAP_SIZE in bytes
+uint32_t e820_get_usable_total(struct e820_map *map);
+
+#endif
@@ -0,0 +1,415 @@
+#include "frame.h"
+#include "config.h"
+#include "error.h"
+#include "kernel.h"
+#include "memory/e820/e820.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+struct frame_pool {
+  // Page frame number (physical address / NUTSOS_FRAME_SIZE) of the first frame of the pool
+  uint32_t base;
+
+  // Frames between the first and the last usable one (including holes)
+  uint32_t span;
+
+  // Usable frames
+  uint32_t total;
+
+  // The free frame numbers (relative to base) are kept in two stacks sharing the same array:
+  // frames of unknown content grow from the bottom (stack[dirty - 1] is the next one to be handed out)
+  // while frames known to be zero-filled grow from the top (stack[total - zeroed] is the next one)
+  uint32_t *stack;
+  uint32_t dirty;
+  uint32_t zeroed;
+
+  // One bit per frame, set when the frame is in use
+  uint8_t *bitmap;
+
+  // Number of owners of each frame in use (address spaces sharing it copy-on-write)
+  uint16_t *refs;
+};
+
+// Frames of the RAM mapped at NUTSOS_KERNEL_VIRTUAL_BASE
+static struct frame_pool frame_pool;
+
+#ifdef NUTSOS_PAGING_PAE
+// Frames past NUTSOS_KERNEL_DIRECT_MAP_SIZE, only handed out for user pages. The kernel can't reach them
+// without paging_kmap, so none of them is ever zeroed ahead of time
+static struct frame_pool frame_high_pool;
+#endif
+
+static uint32_t frame_get_pfn(paging_phys phys)
+{
+  return phys / NUTSOS_FRAME_SIZE;
+}
+
+static paging_phys frame_get_address(struct frame_pool *pool, uint32_t number)
+{
+  return (paging_phys)(pool->base + number) * NUTSOS_FRAME_SIZE;
+}
+
+static void *frame_from_number(uint32_t number)
+{
+  return PAGING_PHYS_TO_VIRT(frame_get_address(&frame_pool, number));
+}
+
+static bool frame_is_used(struct frame_pool *pool, uint32_t number)
+{
+  return pool->bitmap[number / 8] & (1 << (number % 8));
+}
+
+static void frame_set_used(struct frame_pool *pool, uint32_t number, bool used)
+{
+  if (used) {
+    pool->bitmap[number / 8] |= (1 << (number % 8));
+  } else {
+    pool->bitmap[number / 8] &= ~(1 << (number % 8));
+  }
+}
+
+// Get the usable range of memory map entry index that lies above start, either in the RAM the kernel
+// maps or (high) past it
+static bool frame_get_usable_range(struct e820_map *map, int index, bool high, paging_phys start, paging_phys *start_out, paging_phys *end_out)
+{
+  uint64_t range_start = 0;
+  uint64_t range_end = 0;
+  if (high) {
+    if (!e820_get_high_range(map, index, &range_start, &range_end)) {
+      return false;
+    }
+  } else {
+    uint32_t low_start = 0;
+    uint32_t low_end = 0;
+    if (!e820_get_usable_range(map, index, &low_start, &low_end)) {
+      return false;
+    }
+    range_start = low_start;
+    range_end = low_end;
+  }
+
+  if (range_end <= start) {
+    return false;
+  }
+
+  *start_out = range_start < start ? start : range_start;
+  *end_out = range_end;
+  return true;
+}
+
+// Fill pool with all the usable frames of memory_map above start (NUTSOS_FRAME_SIZE aligned)
+static int frame_pool_init(struct frame_pool *pool, struct e820_map *memory_map, bool high, paging_phys start)
+{
+  // Find out how many frames are usable and where the last one is
+  uint32_t base = frame_get_pfn(start);
+  uint32_t end = base;
+  uint32_t total = 0;
+  for (int i = 0; i < memory_map->count; i++) {
+    paging_phys region_start = 0;
+    paging_phys region_end = 0;
+    if (frame_get_usable_range(memory_map, i, high, start, &region_start, &region_end)) {
+      total += frame_get_pfn(region_end) - frame_get_pfn(region_start);
+      end = frame_get_pfn(region_end) > end ? frame_get_pfn(region_end) : end;
+    }
+  }
+
+  if (total == 0) {
+    return -ENOMEM;
+  }
+
+  pool->base = base;
+  pool->span = end - base;
+  pool->stack = kmalloc(total * sizeof(uint32_t));
+  pool->bitmap = kmalloc((pool->span + 7) / 8);
+  pool->refs = kzalloc(pool->span * sizeof(uint16_t));
+  if (!pool->stack || !pool->bitmap || !pool->refs) {
+    return -ENOMEM;
+  }
+
+  // Holes in the memory map are never handed out, so they stay marked as in use
+  memset(pool->bitmap, 0xFF, (pool->span + 7) / 8);
+
+  // Push the frames backwards so that the lowest ones get handed out first.
+  // Nothing is known about their content yet, they all start dirty
+  pool->dirty = 0;
+  pool->zeroed = 0;
+  for (int i = memory_map->count - 1; i >= 0; i--) {
+    paging_phys region_start = 0;
+    paging_phys region_end = 0;
+    if (!frame_get_usable_range(memory_map, i, high, start, &region_start, &region_end)) {
+      continue;
+    }
+
+    for (uint32_t pfn = frame_get_pfn(region_end); pfn > frame_get_pfn(region_start); pfn--) {
+      uint32_t number = pfn - 1 - base;
+      // Skip the frames of overlapping regions we've already added
+      if (frame_is_used(pool, number)) {
+        frame_set_used(pool, number, false);
+        pool->stack[pool->dirty++] = number;
+      }
+    }
+  }
+  pool->total = pool->dirty;
+
+  return 0;
+}
+
+int frame_init(struct e820_map *memory_map, void *start)
+{
+  if ((uint32_t)start % NUTSOS_FRAME_SIZE) {
+    return -EINVARG;
+  }
+
+  // The memory map is physical
+  int res = frame_pool_init(&frame_pool, memory_map, false, PAGING_VIRT_TO_PHYS(start));
+  if (res < 0) {
+    return res;
+  }
+
+#ifdef NUTSOS_PAGING_PAE
+  // The frames above the kernel mapping are a bonus, carry on without them if they can't be tracked
+  if (frame_pool_init(&frame_high_pool, memory_map, true, NUTSOS_KERNEL_DIRECT_MAP_SIZE) < 0) {
+    kfree(frame_high_pool.stack);
+    kfree(frame_high_pool.bitmap);
+    kfree(frame_high_pool.refs);
+    memset(&frame_high_pool, 0, sizeof(frame_high_pool));
+  }
+#endif
+
+  return 0;
+}
+
+static uint32_t frame_pop_dirty(struct frame_pool *pool)
+{
+  return pool->stack[--pool->dirty];
+}
+
+static uint32_t frame_pop_zeroed(struct frame_pool *pool)
+{
+  return pool->stack[pool->total - pool->zeroed--];
+}
+
+static void frame_push_zeroed(struct frame_pool *pool, uint32_t number)
+{
+  pool->stack[pool->total - ++pool->zeroed] = number;
+}
+
+static uint32_t frame_free_count(struct frame_pool *pool)
+{
+  return pool->dirty + pool->zeroed;
+}
+
+// Mark a frame just taken off the free stacks as in use by a single owner
+static void frame_take(struct frame_pool *pool, uint32_t number)
+{
+  frame_set_used(pool, number, true);
+  pool->refs[number] = 1;
+}
+
+// Dirty frames are handed out first so that the zeroed ones are kept for frame_zalloc
+void *frame_alloc()
+{
+  uint32_t number = 0;
+  if (frame_pool.dirty) {
+    number = frame_pop_dirty(&frame_pool);
+  } else if (frame_pool.zeroed) {
+    number = frame_pop_zeroed(&frame_pool);
+  } else {
+    return 0;
+  }
+
+  frame_take(&frame_pool, number);
+  return frame_from_number(number);
+}
+
+void *frame_zalloc()
+{
+  if (!frame_pool.zeroed) {
+    void *frame = frame_alloc();
+    if (frame) {
+      memset(frame, 0x00, NUTSOS_FRAME_SIZE);
+    }
+    return frame;
+  }
+
+  uint32_t number = frame_pop_zeroed(&frame_pool);
+  frame_take(&frame_pool, number);
+  return frame_from_number(number);
+}
+
+int frame_alloc_batch(void **frames, int count)
+{
+  if (count < 0) {
+    return -EINVARG;
+  }
+
+  if (frame_free_count(&frame_pool) < (uint32_t)count) {
+    return -ENOMEM;
+  }
+
+  for (int i = 0; i < count; i++) {
+    frames[i] = frame_alloc();
+  }
+
+  return 0;
+}
+
+int frame_zalloc_batch(void **frames, int count)
+{
+  if (count < 0) {
+    return -EINVARG;
+  }
+
+  if (frame_free_count(&frame_pool) < (uint32_t)count) {
+    return -ENOMEM;
+  }
+
+  for (int i = 0; i < count; i++) {
+    frames[i] = frame_zalloc();
+  }
+
+  return 0;
+}
+
+// Returns a frame of the high pool, 0 if there's none left (or no high pool at all)
+static paging_phys frame_high_alloc()
+{
+#ifdef NUTSOS_PAGING_PAE
+  if (frame_high_pool.dirty) {
+    uint32_t number = frame_pop_dirty(&frame_high_pool);
+    frame_take(&frame_high_pool, number);
+    return frame_get_address(&frame_high_pool, number);
+  }
+#endif
+
+  return 0;
+}
+
+// The RAM the kernel maps is the scarce one, user pages come from above it first
+paging_phys frame_user_alloc()
+{
+  paging_phys frame = frame_high_alloc();
+  if (frame) {
+    return frame;
+  }
+
+  void *low_frame = frame_alloc();
+  return low_frame ? PAGING_VIRT_TO_PHYS(low_frame) : 0;
+}
+
+paging_phys frame_user_zalloc()
+{
+  paging_phys frame = frame_high_alloc();
+  if (frame) {
+    memset(paging_kmap(0, frame), 0x00, NUTSOS_FRAME_SIZE);
+    return frame;
+  }
+
+  void *low_frame = frame_zalloc();
+  return low_frame ? PAGING_VIRT_TO_PHYS(low_frame) : 0;
+}
+
+// Returns the pool the frame at the physical address frame belongs to
+static struct frame_pool *frame_get_pool(paging_phys frame)
+{
+#ifdef NUTSOS_PAGING_PAE
+  if (frame >= NUTSOS_KERNEL_DIRECT_MAP_SIZE) {
+    return &frame_high_pool;
+  }
+#endif
+
+  return &frame_pool;
+}
+
+// Returns the number of a frame in use in pool, panics if frame is not one
+static uint32_t frame_get_used_number(struct frame_pool *pool, paging_phys frame)
+{
+  uint32_t pfn = frame_get_pfn(frame);
+  if (pfn < pool->base || pfn - pool->base >= pool->span || (frame & (NUTSOS_FRAME_SIZE - 1))) {
+    panic("Not a frame of the frame pool\n");
+  }
+
+  uint32_t number = pfn - pool->base;
+  if (!frame_is_used(pool, number)) {
+    panic("The frame is not in use\n");
+  }
+
+  return number;
+}
+
+void frame_phys_ref(paging_phys frame)
+{
+  struct frame_pool *pool = frame_get_pool(frame);
+  uint32_t number = frame_get_used_number(pool, frame);
+  if (pool->refs[number] == UINT16_MAX) {
+    panic("Too many references to a frame\n");
+  }
+
+  pool->refs[number]++;
+}
+
+uint32_t frame_phys_get_refs(paging_phys frame)
+{
+  struct frame_pool *pool = frame_get_pool(frame);
+  return pool->refs[frame_get_used_number(pool, frame)];
+}
+
+void frame_phys_free(paging_phys frame)
+{
+  struct frame_pool *pool = frame_get_pool(frame);
+  uint32_t number = frame_get_used_number(pool, frame);
+  if (--pool->refs[number]) {
+    return;
+  }
+
+  frame_set_used(pool, number, false);
+  pool->stack[pool->dirty++] = number;
+}
+
+void frame_ref(void *frame)
+{
+  frame_phys_ref(PAGING_VIRT_TO_PHYS(frame));
+}
+
+uint32_t frame_get_refs(void *frame)
+{
+  return frame_phys_get_refs(PAGING_VIRT_TO_PHYS(frame));
+}
+
+void frame_free(void *frame)
+{
+  frame_phys_free(PAGING_VIRT_TO_PHYS(frame));
+}
+
+void frame_free_batch(void **frames, int count)
+{
+  for (int i = 0; i < count; i++) {
+    frame_free(frames[i]);
+  }
+}
+
+int frame_zero_pool_refill(int max_frames)
+{
+  int total = 0;
+  while (total < max_frames && frame_pool.dirty && frame_pool.zeroed < NUTSOS_FRAME_ZERO_POOL_SIZE) {
+    uint32_t number = frame_pop_dirty(&frame_pool);
+    memset(frame_from_number(number), 0x00, NUTSOS_FRAME_SIZE);
+    frame_push_zeroed(&frame_pool, number);
+    total++;
+  }
+
+  return total;
+}
+
+void frame_get_stats(struct frame_stats *stats)
+{
+  stats->total = frame_pool.total;
+  stats->free = frame_free_count(&frame_pool);
+#ifdef NUTSOS_PAGING_PAE
+  stats->total += frame_high_pool.total;
+  stats->free += frame_free_count(&frame_high_pool);
+#endif
+  stats->used = stats->total - stats->free;
+  stats->zeroed = frame_pool.zeroed;
+}
@@ -0,0 +1,78 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "memory/paging/paging.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Physical page frame allocator.
+// Page directories, page tables and user memory are handed out in NUTSOS_FRAME_SIZE frames from a
+// dedicated pool so that they don't compete with (and fragment) the kernel heap.
+// Free frames are kept on a stack, which makes allocating and freeing a frame O(1), while a bitmap
+// tracks which frames are in use to catch double frees.
+// A frame can have more than one owner (see frame_ref), it's only given back once all of them freed it.
+// Frames zeroed ahead of time (see frame_zero_pool_refill) are kept on a separate stack so that
+// frame_zalloc can hand them out without zeroing them on the spot.
+// With PAE, the RAM past NUTSOS_KERNEL_DIRECT_MAP_SIZE makes up a second pool the kernel doesn't map:
+// its frames are only used for user pages and are known by their physical address (see frame_user_alloc).
+
+struct frame_stats {
+  uint32_t total;
+  uint32_t free;
+  uint32_t used;
+
+  // Free frames that are already zero-filled
+  uint32_t zeroed;
+};
+
+struct e820_map;
+
+// Initialise the allocator with all the usable RAM in memory_map above start (NUTSOS_FRAME_SIZE aligned).
+// Frames are handed out as pointers to the kernel mapping of the RAM, see PAGING_VIRT_TO_PHYS for the
+// physical address to put in a page table
+int frame_init(struct e820_map *memory_map, void *start);
+
+// Allocate a single frame, returns NULL if there are no free frames
+void *frame_alloc();
+
+// Allocate a single zero-filled frame, taken from the pre-zeroed pool when possible
+void *frame_zalloc();
+
+// Allocate count frames into frames, either all of them are allocated or none is
+int frame_alloc_batch(void **frames, int count);
+
+// Same as frame_alloc_batch, but the frames are zero-filled
+int frame_zalloc_batch(void **frames, int count);
+
+// Give a frame back to the allocator, or drop one of its references if it's shared
+void frame_free(void *frame);
+
+// Add an owner to a frame in use, it then takes one more frame_free to release it
+void frame_ref(void *frame);
+
+// Returns the number of owners of a frame in use
+uint32_t frame_get_refs(void *frame);
+
+// Give count frames back to the allocator
+void frame_free_batch(void **frames, int count);
+
+// Allocate a single frame for a user page, from above the RAM mapped by the kernel when there's any
+// (see paging_kmap to access it). Returns its physical address, 0 if there are no free frames
+paging_phys frame_user_alloc();
+
+// Same as frame_user_alloc, but the frame is zero-filled (through kmap slot 0)
+paging_phys frame_user_zalloc();
+
+// Same as frame_free, frame_ref and frame_get_refs but for the physical address of a frame of either pool
+void frame_phys_free(paging_phys frame);
+void frame_phys_ref(paging_phys frame);
+uint32_t frame_phys_get_refs(paging_phys frame);
+
+// Zero up to max_frames free frames ahead of time, until NUTSOS_FRAME_ZERO_POOL_SIZE are ready.
+// Meant to be called when the CPU has nothing better to do, returns how many frames were zeroed
+int frame_zero_pool_refill(int max_frames);
+
+// Fill stats with the current frame usage
+void frame_get_stats(struct frame_stats *stats);
+
+#endif
@@ -0,0 +1,276 @@
+#include "error.h"
+#include "heap.h"
+#include "kernel.h"
+#include "memory/memory.h"
+#include <stdbool.h>
+
+#if NUTSOS_HEAP_BACKEND == NUTSOS_HEAP_BACKEND_BUDDY
+
+// Binary buddy allocator.
+// Every allocation is a chunk of 2^order blocks starting at a block index that is a multiple of 2^order.
+// The buddy of the chunk at block b of order k is the chunk at b ^ 2^k: when both are free they are merged
+// into a single chunk of order k+1, so both allocating and freeing take at most HEAP_BUDDY_MAX_ORDER steps.
+
+static bool heap_validate_alignment(void *ptr)
+{
+  return ((unsigned int)ptr % NUTSOS_HEAP_BLOCK_SIZE) == 0;
+}
+
+size_t heap_table_size(size_t total_blocks)
+{
+  return sizeof(heap_block_table_entry_t) * total_blocks;
+}
+
+static heap_block_table_entry_t heap_buddy_make_entry(int order, bool taken)
+{
+  heap_block_table_entry_t entry = HEAP_BLOCK_IS_FIRST | (order << HEAP_BLOCK_ORDER_SHIFT);
+  if (taken) {
+    entry |= HEAP_BLOCK_TABLE_ENTRY_TAKEN;
+  }
+  return entry;
+}
+
+static int heap_buddy_get_order(heap_block_table_entry_t entry)
+{
+  return (entry & HEAP_BLOCK_MASK_ORDER) >> HEAP_BLOCK_ORDER_SHIFT;
+}
+
+static bool heap_buddy_is_free_chunk(heap_block_table_entry_t entry, int order)
+{
+  return (entry & HEAP_BLOCK_IS_FIRST) && !(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN) && heap_buddy_get_order(entry) == order;
+}
+
+static struct heap_buddy_node *heap_buddy_block_to_node(struct heap *heap, size_t block)
+{
+  return (struct heap_buddy_node *)(heap->saddr + (block * NUTSOS_HEAP_BLOCK_SIZE));
+}
+
+static size_t heap_buddy_node_to_block(struct heap *heap, struct heap_buddy_node *node)
+{
+  return ((size_t)((void *)node - heap->saddr)) / NUTSOS_HEAP_BLOCK_SIZE;
+}
+
+static void heap_buddy_push(struct heap *heap, size_t block, int order)
+{
+  struct heap_buddy_node *node = heap_buddy_block_to_node(heap, block);
+  node->prev = 0;
+  node->next = heap->free_lists[order];
+  if (node->next) {
+    node->next->prev = node;
+  }
+  heap->free_lists[order] = node;
+  heap->table->entries[block] = heap_buddy_make_entry(order, false);
+}
+
+static void heap_buddy_remove(struct heap *heap, size_t block, int order)
+{
+  struct heap_buddy_node *node = heap_buddy_block_to_node(heap, block);
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    heap->free_lists[order] = node->next;
+  }
+
+  if (node->next) {
+    node->next->prev = node->prev;
+  }
+}
+
+int heap_create(struct heap *heap, void *ptr, void *end, struct heap_table *table)
+{
+  // Make sure both beginning and end are 4k-aligned
+  if (!heap_validate_alignment(ptr) || !heap_validate_alignment(end)) {
+    return -EINVARG;
+  }
+
+  if (table->total != (size_t)(end - ptr) / NUTSOS_HEAP_BLOCK_SIZE) {
+    return -EINVARG;
+  }
+
+  memset(heap, 0, sizeof(struct heap));
+  heap->saddr = ptr;
+  heap->table = table;
+  table->group_free = 0;
+  table->super_free = 0;
+
+  memset(table->entries, HEAP_BLOCK_TABLE_ENTRY_FREE, heap_table_size(table->total));
+
+  // Carve the heap in the largest aligned chunks that fit, the heap size doesn't need to be a power of two
+  size_t block = 0;
+  while (block < table->total) {
+    int order = HEAP_BUDDY_MAX_ORDER;
+    while ((block % (1 << order)) != 0 || block + (1 << order) > table->total) {
+      order--;
+    }
+    heap_buddy_push(heap, block, order);
+    block += 1 << order;
+  }
+
+  return 0;
+}
+
+// Returns the smallest order whose chunks can hold size bytes
+static int heap_buddy_order_for_size(size_t size)
+{
+  size_t total_blocks = (size + NUTSOS_HEAP_BLOCK_SIZE - 1) / NUTSOS_HEAP_BLOCK_SIZE;
+  int order = 0;
+  while ((1 << order) < total_blocks) {
+    order++;
+  }
+  return order;
+}
+
+void *heap_malloc(struct heap *heap, size_t size)
+{
+  if (size == 0) {
+    return 0;
+  }
+
+  int order = heap_buddy_order_for_size(size);
+  if (order > HEAP_BUDDY_MAX_ORDER) {
+    return 0;
+  }
+
+  // Find the smallest free chunk that is large enough
+  int k = order;
+  while (k <= HEAP_BUDDY_MAX_ORDER && !heap->free_lists[k]) {
+    k++;
+  }
+
+  if (k > HEAP_BUDDY_MAX_ORDER) {
+    return 0;
+  }
+
+  size_t block = heap_buddy_node_to_block(heap, heap->free_lists[k]);
+  heap_buddy_remove(heap, block, k);
+
+  // Split it in half until it's the right size, giving the upper halves back to the free lists
+  while (k > order) {
+    k--;
+    heap_buddy_push(heap, block + (1 << k), k);
+  }
+
+  heap->table->entries[block] = heap_buddy_make_entry(order, true);
+  return heap->saddr + (block * NUTSOS_HEAP_BLOCK_SIZE);
+}
+
+size_t heap_allocation_size(struct heap *heap, void *ptr)
+{
+  size_t block = ((size_t)(ptr - heap->saddr)) / NUTSOS_HEAP_BLOCK_SIZE;
+  return (1 << heap_buddy_get_order(heap->table->entries[block])) * NUTSOS_HEAP_BLOCK_SIZE;
+}
+
+int heap_resize(struct heap *heap, void *ptr, size_t size)
+{
+  struct heap_table *table = heap->table;
+  size_t block = ((size_t)(ptr - heap->saddr)) / NUTSOS_HEAP_BLOCK_SIZE;
+  int order = heap_buddy_get_order(table->entries[block]);
+  int new_order = heap_buddy_order_for_size(size);
+  if (size == 0 || new_order > HEAP_BUDDY_MAX_ORDER) {
+    return -EINVARG;
+  }
+
+  // Shrinking: split the chunk giving the upper halves back, their buddy is in use so there's nothing to merge
+  if (new_order <= order) {
+    while (order > new_order) {
+      order--;
+      heap_buddy_push(heap, block + (1 << order), order);
+    }
+    table->entries[block] = heap_buddy_make_entry(order, true);
+    return 0;
+  }
+
+  // Growing in place is only possible when the chunk is the lower half at every order
+  // up to new_order and all the upper halves are free
+  for (int k = order; k < new_order; k++) {
+    size_t buddy = block ^ (1 << k);
+    if (buddy < block || buddy >= table->total || !heap_buddy_is_free_chunk(table->entries[buddy], k)) {
+      return -ENOMEM;
+    }
+  }
+
+  for (int k = order; k < new_order; k++) {
+    size_t buddy = block ^ (1 << k);
+    heap_buddy_remove(heap, buddy, k);
+    table->entries[buddy] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+  }
+  table->entries[block] = heap_buddy_make_entry(new_order, true);
+
+  return 0;
+}
+
+// Free chunks hold their free list node, so nothing is known to be zero-filled
+void *heap_zalloc(struct heap *heap, size_t size)
+{
+  void *ptr = heap_malloc(heap, size);
+  if (ptr) {
+    memset(ptr, 0x00, size);
+  }
+  return ptr;
+}
+
+int heap_zero_free_blocks(struct heap *heap, int max_blocks)
+{
+  return 0;
+}
+
+// The chunks tile the whole heap, so the table can be walked one chunk at a time
+void heap_get_fragmentation(struct heap *heap, struct heap_fragmentation *frag)
+{
+  struct heap_table *table = heap->table;
+  memset(frag, 0, sizeof(struct heap_fragmentation));
+
+  size_t run_start = 0;
+  size_t run_length = 0;
+  size_t block = 0;
+  while (block < table->total) {
+    heap_block_table_entry_t entry = table->entries[block];
+    size_t chunk_blocks = 1 << heap_buddy_get_order(entry);
+    if (!(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN)) {
+      if (run_length == 0) {
+        run_start = block;
+      }
+      run_length += chunk_blocks;
+    } else if (run_length) {
+      heap_fragmentation_add_run(frag, table->total, run_start, run_length);
+      run_length = 0;
+    }
+    block += chunk_blocks;
+  }
+
+  if (run_length) {
+    heap_fragmentation_add_run(frag, table->total, run_start, run_length);
+  }
+}
+
+void heap_free(struct heap *heap, void *ptr)
+{
+  struct heap_table *table = heap->table;
+  size_t block = ((size_t)(ptr - heap->saddr)) / NUTSOS_HEAP_BLOCK_SIZE;
+  heap_block_table_entry_t entry = table->entries[block];
+  if (!(entry & HEAP_BLOCK_IS_FIRST) || !(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN)) {
+    // Not the beginning of an allocation
+    return;
+  }
+
+  // Coalesce with the buddy for as long as it's free
+  int order = heap_buddy_get_order(entry);
+  table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+  while (order < HEAP_BUDDY_MAX_ORDER) {
+    size_t buddy = block ^ (1 << order);
+    if (buddy >= table->total || !heap_buddy_is_free_chunk(table->entries[buddy], order)) {
+      break;
+    }
+
+    heap_buddy_remove(heap, buddy, order);
+    table->entries[buddy] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+    if (buddy < block) {
+      block = buddy;
+    }
+    order++;
+  }
+
+  heap_buddy_push(heap, block, order);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#include "heap.h"
+
+void heap_fragmentation_add_run(struct heap_fragmentation *frag, size_t total_blocks, size_t start, size_t length)
+{
+  frag->free_blocks += length;
+  frag->free_runs++;
+  if (length > frag->largest_free_run) {
+    frag->largest_free_run = length;
+  }
+
+  int bucket = 0;
+  while (bucket < HEAP_FRAGMENTATION_BUCKETS - 1 && (length >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+  frag->run_histogram[bucket]++;
+
+  for (size_t i = start; i < start + length; i++) {
+    frag->map[(i * HEAP_FRAGMENTATION_MAP_SLICES) / total_blocks]++;
+  }
+}
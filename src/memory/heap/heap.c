@@ -4,6 +4,8 @@
 #include "memory/memory.h"
 #include <stdbool.h>
 
+#if NUTSOS_HEAP_BACKEND == NUTSOS_HEAP_BACKEND_BLOCK
+
 static int heap_validate_table(void *ptr, void *end, struct heap_table *table)
 {
   size_t table_size = (size_t)(end - ptr);
@@ -20,6 +22,56 @@ static bool heap_validate_alignment(void *ptr)
   return ((unsigned int)ptr % NUTSOS_HEAP_BLOCK_SIZE) == 0;
 }
 
+static size_t heap_table_group_count(size_t total_blocks)
+{
+  return (total_blocks + HEAP_TABLE_GROUP_BLOCKS - 1) / HEAP_TABLE_GROUP_BLOCKS;
+}
+
+static size_t heap_table_super_count(size_t total_blocks)
+{
+  return (total_blocks + HEAP_TABLE_SUPER_BLOCKS - 1) / HEAP_TABLE_SUPER_BLOCKS;
+}
+
+size_t heap_table_size(size_t total_blocks)
+{
+  // Entries, then group counts, then super group counts (2-byte aligned)
+  size_t size = sizeof(heap_block_table_entry_t) * total_blocks + sizeof(uint8_t) * heap_table_group_count(total_blocks);
+  size += size % sizeof(uint16_t);
+  return size + sizeof(uint16_t) * heap_table_super_count(total_blocks);
+}
+
+// Returns how many blocks are in a group, the last one might be smaller than HEAP_TABLE_GROUP_BLOCKS
+static size_t heap_table_group_blocks(struct heap_table *table, size_t group)
+{
+  size_t remaining = table->total - (group * HEAP_TABLE_GROUP_BLOCKS);
+  return remaining < HEAP_TABLE_GROUP_BLOCKS ? remaining : HEAP_TABLE_GROUP_BLOCKS;
+}
+
+// Returns how many blocks are in a super group, the last one might be smaller than HEAP_TABLE_SUPER_BLOCKS
+static size_t heap_table_super_blocks(struct heap_table *table, size_t super)
+{
+  size_t remaining = table->total - (super * HEAP_TABLE_SUPER_BLOCKS);
+  return remaining < HEAP_TABLE_SUPER_BLOCKS ? remaining : HEAP_TABLE_SUPER_BLOCKS;
+}
+
+static void heap_table_init_summary(struct heap_table *table)
+{
+  size_t groups = heap_table_group_count(table->total);
+  size_t supers = heap_table_super_count(table->total);
+
+  table->group_free = (uint8_t *)(table->entries + table->total);
+  table->super_free = (uint16_t *)((void *)table->entries + heap_table_size(table->total) - sizeof(uint16_t) * supers);
+
+  // Everything starts free
+  for (size_t g = 0; g < groups; g++) {
+    table->group_free[g] = heap_table_group_blocks(table, g);
+  }
+
+  for (size_t s = 0; s < supers; s++) {
+    table->super_free[s] = heap_table_super_blocks(table, s);
+  }
+}
+
 int heap_create(struct heap *heap, void *ptr, void *end, struct heap_table *table)
 {
   int res = 0;
@@ -40,6 +92,7 @@ int heap_create(struct heap *heap, void *ptr, void *end, struct heap_table *tabl
 
   size_t table_size = sizeof(heap_block_table_entry_t) * table->total;
   memset(table->entries, HEAP_BLOCK_TABLE_ENTRY_FREE, table_size);
+  heap_table_init_summary(table);
 
   return 0;
 }
@@ -61,37 +114,71 @@ static int heap_get_entry_type(heap_block_table_entry_t entry)
   return entry & HEAP_BLOCK_MASK_TYPE;
 }
 
+// Keep the free counts of the summary in sync when a block changes state (delta is +1 or -1)
+static void heap_table_update_summary(struct heap_table *table, int block, int delta)
+{
+  table->group_free[block / HEAP_TABLE_GROUP_BLOCKS] += delta;
+  table->super_free[block / HEAP_TABLE_SUPER_BLOCKS] += delta;
+}
+
+// First-fit search for total_blocks contiguous free blocks.
+// At the beginning of each super group (and group) the summary tells whether
+// all of its blocks are taken, in which case the whole range is skipped, or all of them
+// are free, in which case the whole range is added to the current run in one go.
+// Only mixed groups are scanned entry by entry.
 int heap_get_next_free_block(struct heap *heap, uint32_t total_blocks)
 {
   struct heap_table *table = heap->table;
-  int bc = 0;
-  int bs = -1;
+  size_t run_start = 0;
+  size_t run_length = 0;
+  size_t i = 0;
 
-  for (size_t i = 0; i < table->total; i++) {
-    // Not free, let's skip the entry, reset the count and move on to the next one
-    if (heap_get_entry_type(table->entries[i]) != HEAP_BLOCK_TABLE_ENTRY_FREE) {
-      bc = 0;
-      bs = -1;
+  if (total_blocks == 0) {
+    return -EINVARG;
+  }
+
+  while (i < table->total) {
+    size_t span = 0;
+    size_t free = 0;
+
+    if ((i % HEAP_TABLE_SUPER_BLOCKS) == 0) {
+      span = heap_table_super_blocks(table, i / HEAP_TABLE_SUPER_BLOCKS);
+      free = table->super_free[i / HEAP_TABLE_SUPER_BLOCKS];
+    }
+
+    if ((span == 0 || (free != 0 && free != span)) && (i % HEAP_TABLE_GROUP_BLOCKS) == 0) {
+      span = heap_table_group_blocks(table, i / HEAP_TABLE_GROUP_BLOCKS);
+      free = table->group_free[i / HEAP_TABLE_GROUP_BLOCKS];
+    }
+
+    if (span == 0 || (free != 0 && free != span)) {
+      // Mixed group, look at the single entry
+      span = 1;
+      free = heap_get_entry_type(table->entries[i]) == HEAP_BLOCK_TABLE_ENTRY_FREE;
+    }
+
+    i += span;
+
+    // Not free, reset the count and move on to the next range
+    if (free == 0) {
+      run_length = 0;
       continue;
     }
 
-    // If this is the first block
-    if (bs == -1) {
-      bs = i;
+    // If this is the first block of the run
+    if (run_length == 0) {
+      run_start = i - span;
     }
-    bc++;
+    run_length += span;
+
     // We found space large enough, time to ret
-    if (bc == total_blocks) {
-      break;
+    if (run_length >= total_blocks) {
+      return run_start;
     }
   }
 
   // Could not find a valid chunk of memory to allocate
-  if (bs == -1) {
-    return -ENOMEM;
-  }
-
-  return bs;
+  return -ENOMEM;
 }
 
 void *heap_block_to_address(struct heap *heap, int block)
@@ -116,6 +203,7 @@ void heap_mark_blocks_taken(struct heap *heap, int start_block, int total_blocks
 
   for (int i = start_block; i <= end_block; i++) {
     heap->table->entries[i] = entry;
+    heap_table_update_summary(heap->table, i, -1);
     entry = HEAP_BLOCK_TABLE_ENTRY_TAKEN;
     if (i != end_block - 1) {
       entry |= HEAP_BLOCK_HAS_NEXT;
@@ -148,6 +236,7 @@ void heap_mark_blocks_free(struct heap *heap, int starting_block)
   for (int i = starting_block; i < (int)table->total; i++) {
     heap_block_table_entry_t entry = table->entries[i];
     table->entries[i] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+    heap_table_update_summary(table, i, +1);
     if (!(entry & HEAP_BLOCK_HAS_NEXT)) {
       break;
     }
@@ -161,7 +250,149 @@ void *heap_malloc(struct heap *heap, size_t size)
   return heap_malloc_blocks(heap, total_blocks);
 }
 
+void *heap_zalloc(struct heap *heap, size_t size)
+{
+  size_t aligned_size = heap_align_value_to_upper(size);
+  uint32_t total_blocks = aligned_size / NUTSOS_HEAP_BLOCK_SIZE;
+
+  int start_block = heap_get_next_free_block(heap, total_blocks);
+  if (start_block < 0) {
+    return 0;
+  }
+
+  // Only clear what heap_zero_free_blocks hasn't already, marking the blocks taken drops the flag
+  for (int i = start_block; i < start_block + (int)total_blocks; i++) {
+    if (!(heap->table->entries[i] & HEAP_BLOCK_IS_ZERO)) {
+      memset(heap_block_to_address(heap, i), 0x00, NUTSOS_HEAP_BLOCK_SIZE);
+    }
+  }
+
+  heap_mark_blocks_taken(heap, start_block, total_blocks);
+  return heap_block_to_address(heap, start_block);
+}
+
+int heap_zero_free_blocks(struct heap *heap, int max_blocks)
+{
+  struct heap_table *table = heap->table;
+  int total = 0;
+  size_t scanned = 0;
+
+  while (scanned < table->total && total < max_blocks) {
+    size_t i = heap->zero_cursor;
+
+    // Skip groups without free blocks altogether
+    if ((i % HEAP_TABLE_GROUP_BLOCKS) == 0 && table->group_free[i / HEAP_TABLE_GROUP_BLOCKS] == 0) {
+      size_t span = heap_table_group_blocks(table, i / HEAP_TABLE_GROUP_BLOCKS);
+      heap->zero_cursor = (i + span) % table->total;
+      scanned += span;
+      continue;
+    }
+
+    heap->zero_cursor = (i + 1) % table->total;
+    scanned++;
+
+    heap_block_table_entry_t entry = table->entries[i];
+    if (heap_get_entry_type(entry) != HEAP_BLOCK_TABLE_ENTRY_FREE || (entry & HEAP_BLOCK_IS_ZERO)) {
+      continue;
+    }
+
+    memset(heap_block_to_address(heap, i), 0x00, NUTSOS_HEAP_BLOCK_SIZE);
+    table->entries[i] |= HEAP_BLOCK_IS_ZERO;
+    total++;
+  }
+
+  return total;
+}
+
+static size_t heap_get_chunk_blocks(struct heap *heap, int start_block)
+{
+  struct heap_table *table = heap->table;
+  size_t total = 1;
+  for (size_t i = start_block; i < table->total - 1 && (table->entries[i] & HEAP_BLOCK_HAS_NEXT); i++) {
+    total++;
+  }
+  return total;
+}
+
+size_t heap_allocation_size(struct heap *heap, void *ptr)
+{
+  return heap_get_chunk_blocks(heap, heap_address_to_block(heap, ptr)) * NUTSOS_HEAP_BLOCK_SIZE;
+}
+
+int heap_resize(struct heap *heap, void *ptr, size_t size)
+{
+  struct heap_table *table = heap->table;
+  int start_block = heap_address_to_block(heap, ptr);
+  int current_blocks = heap_get_chunk_blocks(heap, start_block);
+  int total_blocks = heap_align_value_to_upper(size) / NUTSOS_HEAP_BLOCK_SIZE;
+  if (total_blocks == 0) {
+    return -EINVARG;
+  }
+
+  if (total_blocks < current_blocks) {
+    // The new last block ends the chain, everything after it goes back to the heap
+    table->entries[start_block + total_blocks - 1] &= ~HEAP_BLOCK_HAS_NEXT;
+    heap_mark_blocks_free(heap, start_block + total_blocks);
+    return 0;
+  }
+
+  // Growing in place needs all the blocks right after the allocation to be free
+  int end_block = start_block + total_blocks;
+  if (end_block > (int)table->total) {
+    return -ENOMEM;
+  }
+
+  for (int i = start_block + current_blocks; i < end_block; i++) {
+    if (heap_get_entry_type(table->entries[i]) != HEAP_BLOCK_TABLE_ENTRY_FREE) {
+      return -ENOMEM;
+    }
+  }
+
+  // Extend the chain
+  for (int i = start_block + current_blocks - 1; i < end_block; i++) {
+    if (i >= start_block + current_blocks) {
+      table->entries[i] = HEAP_BLOCK_TABLE_ENTRY_TAKEN;
+      heap_table_update_summary(table, i, -1);
+    }
+
+    if (i != end_block - 1) {
+      table->entries[i] |= HEAP_BLOCK_HAS_NEXT;
+    }
+  }
+
+  return 0;
+}
+
+void heap_get_fragmentation(struct heap *heap, struct heap_fragmentation *frag)
+{
+  struct heap_table *table = heap->table;
+  memset(frag, 0, sizeof(struct heap_fragmentation));
+
+  size_t run_start = 0;
+  size_t run_length = 0;
+  for (size_t i = 0; i < table->total; i++) {
+    if (heap_get_entry_type(table->entries[i]) == HEAP_BLOCK_TABLE_ENTRY_FREE) {
+      if (run_length == 0) {
+        run_start = i;
+      }
+      run_length++;
+      continue;
+    }
+
+    if (run_length) {
+      heap_fragmentation_add_run(frag, table->total, run_start, run_length);
+      run_length = 0;
+    }
+  }
+
+  if (run_length) {
+    heap_fragmentation_add_run(frag, table->total, run_start, run_length);
+  }
+}
+
 void heap_free(struct heap *heap, void *ptr)
 {
   heap_mark_blocks_free(heap, heap_address_to_block(heap, ptr));
-}
\ No newline at end of file
+}
+
+#endif
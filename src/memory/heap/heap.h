@@ -12,7 +12,8 @@
 // Bit | Description
 // ----+---------------------------------------------------------------
 //  0  | Equals 1 if the block is in use, 0 otherwise
-// 1-5 | Unused
+//  1  | Equals 1 if the block is free and known to be zero-filled
+// 2-5 | Unused
 //  6  | Equals 1 if this is the first block of an allocated chunk
 //  7  | Equals 1 if this is not the last block of an allocated chunk
 
@@ -22,27 +23,111 @@
 
 #define HEAP_BLOCK_HAS_NEXT          0b10000000
 #define HEAP_BLOCK_IS_FIRST          0b01000000
+#define HEAP_BLOCK_IS_ZERO           0b00000010
+
+// The buddy backend (NUTSOS_HEAP_BACKEND_BUDDY) uses the same table differently: the heap is split
+// in chunks of 2^order blocks, aligned to their size, and only the first entry of each chunk is used:
+// Bit | Description
+// ----+---------------------------------------------------------------
+//  0  | Equals 1 if the chunk is in use, 0 otherwise
+// 1-5 | Order of the chunk
+//  6  | Equals 1 if this is the first block of a chunk (free or in use)
+//  7  | Unused
+// Free chunks of each order are kept in doubly linked lists stored in the chunks themselves.
+#define HEAP_BLOCK_MASK_ORDER        0b00111110
+#define HEAP_BLOCK_ORDER_SHIFT       1
+#define HEAP_BUDDY_MAX_ORDER         20
+
+// Scanning the table one entry at a time gets slower the more the heap is used, so on top of the
+// entries the table keeps a two-level summary of free blocks:
+// - entries are grouped HEAP_TABLE_GROUP_BLOCKS at a time and each group keeps its count of free blocks
+// - groups are gathered HEAP_TABLE_SUPER_GROUPS at a time in super groups with their own free count
+// A search can then skip (or claim) whole taken (or free) groups and super groups at once.
+#define HEAP_TABLE_GROUP_BLOCKS      64
+#define HEAP_TABLE_SUPER_GROUPS      64
+#define HEAP_TABLE_SUPER_BLOCKS      (HEAP_TABLE_GROUP_BLOCKS * HEAP_TABLE_SUPER_GROUPS)
+
+// Fragmentation statistics: free runs are bucketed by size, bucket i counting the runs of 2^i
+// to 2^(i+1)-1 blocks, and the heap is split in HEAP_FRAGMENTATION_MAP_SLICES equal slices
+// to give a coarse map of where the free blocks are.
+#define HEAP_FRAGMENTATION_BUCKETS   12
+#define HEAP_FRAGMENTATION_MAP_SLICES 64
 
 typedef unsigned char heap_block_table_entry_t;
 
 struct heap_table {
   heap_block_table_entry_t *entries;
   size_t total;
+
+  // Free blocks in each group of entries (set up by heap_create, unused by the buddy backend)
+  uint8_t *group_free;
+
+  // Free blocks in each super group of entries (set up by heap_create, unused by the buddy backend)
+  uint16_t *super_free;
+};
+
+struct heap_buddy_node {
+  struct heap_buddy_node *next;
+  struct heap_buddy_node *prev;
 };
 
 struct heap {
   struct heap_table *table;
   // Start address of the heap data pool
   void *saddr;
+
+  // Where heap_zero_free_blocks resumes looking for free blocks to zero
+  size_t zero_cursor;
+
+#if NUTSOS_HEAP_BACKEND == NUTSOS_HEAP_BACKEND_BUDDY
+  // Free chunks of each order
+  struct heap_buddy_node *free_lists[HEAP_BUDDY_MAX_ORDER + 1];
+#endif
 };
 
+struct heap_fragmentation {
+  size_t free_blocks;
+  size_t free_runs;
+  size_t largest_free_run;
+
+  // Free runs by size (the last bucket counts all the bigger runs too)
+  uint32_t run_histogram[HEAP_FRAGMENTATION_BUCKETS];
+
+  // Free blocks in each slice of the heap
+  uint32_t map[HEAP_FRAGMENTATION_MAP_SLICES];
+};
+
+// Returns the bytes of memory needed by the table (entries and summary) of a heap of total_blocks
+size_t heap_table_size(size_t total_blocks);
+
 // Allocate a heap structure
+// table->entries needs to point to heap_table_size(table->total) bytes of memory
 int heap_create(struct heap *heap, void *ptr, void *end, struct heap_table *table);
 
 // Allocate memory on the heap
 void *heap_malloc(struct heap *heap, size_t size);
 
+// Allocate zero-filled memory on the heap, only the blocks not already known to be zero get cleared
+void *heap_zalloc(struct heap *heap, size_t size);
+
+// Zero up to max_blocks free blocks ahead of time so that heap_zalloc doesn't have to,
+// returns how many blocks were zeroed
+int heap_zero_free_blocks(struct heap *heap, int max_blocks);
+
+// Resize the allocation at ptr to size bytes without moving it: shrinking gives the tail blocks back,
+// growing only succeeds if the blocks that follow are free. Returns -ENOMEM if it can't be done in place
+int heap_resize(struct heap *heap, void *ptr, size_t size);
+
+// Returns the size in bytes of the allocation at ptr
+size_t heap_allocation_size(struct heap *heap, void *ptr);
+
 // Free a memory pointer in the heap
 void heap_free(struct heap *heap, void *ptr);
 
+// Walk the heap table and collect its free runs in frag
+void heap_get_fragmentation(struct heap *heap, struct heap_fragmentation *frag);
+
+// Account a run of length free blocks starting at block start, used by the backends' heap_get_fragmentation
+void heap_fragmentation_add_run(struct heap_fragmentation *frag, size_t total_blocks, size_t start, size_t length);
+
 #endif
\ No newline at end of file
@@ -1,42 +1,241 @@
 #include "kheap.h"
 #include "config.h"
 #include "heap.h"
+#include "kheap_profile.h"
 #include "kernel.h"
+#include "memory/e820/e820.h"
 #include "memory/memory.h"
+#include "slab.h"
 #include "terminal/terminal.h"
 
+#ifdef NUTSOS_HEAP_PROFILING
+#define KHEAP_PROFILE(call) call
+#else
+#define KHEAP_PROFILE(call)
+#endif
+
+// One size class per power of two between NUTSOS_HEAP_SLAB_MIN_SIZE and NUTSOS_HEAP_SLAB_MAX_SIZE
+#define KHEAP_SLAB_CLASSES 7
+
 struct heap kernel_heap;
 struct heap_table kernel_heap_table;
+static struct slab_cache kernel_slab_caches[KHEAP_SLAB_CLASSES];
+
+static void kheap_init_slab_caches()
+{
+  size_t size = NUTSOS_HEAP_SLAB_MIN_SIZE;
+  for (int i = 0; i < KHEAP_SLAB_CLASSES; i++) {
+    if (slab_cache_init(&kernel_slab_caches[i], &kernel_heap, size) < 0) {
+      panic("Failed to create slab cache\n");
+    }
+    size <<= 1;
+  }
+}
 
-void kheap_init()
+// Size the heap from the usable RAM: a share of the total, as long as it fits
+// in the usable region the heap starts in
+static uint32_t kheap_get_size(struct e820_map *memory_map)
 {
-  int total_table_entries = NUTSOS_HEAP_SIZE_BYTES / NUTSOS_HEAP_BLOCK_SIZE;
+  uint32_t size = e820_get_usable_total(memory_map) / NUTSOS_HEAP_RAM_SHARE;
+  if (size < NUTSOS_HEAP_MIN_SIZE_BYTES) {
+    size = NUTSOS_HEAP_MIN_SIZE_BYTES;
+  }
+
+  if (size > NUTSOS_HEAP_MAX_SIZE_BYTES) {
+    size = NUTSOS_HEAP_MAX_SIZE_BYTES;
+  }
+
+  uint32_t region_end = e820_get_usable_end(memory_map, NUTSOS_HEAP_PHYSICAL_ADDRESS);
+  if (region_end < NUTSOS_HEAP_PHYSICAL_ADDRESS + size) {
+    size = region_end > NUTSOS_HEAP_PHYSICAL_ADDRESS ? region_end - NUTSOS_HEAP_PHYSICAL_ADDRESS : 0;
+  }
+
+  return size - (size % NUTSOS_HEAP_BLOCK_SIZE);
+}
+
+void kheap_init(struct e820_map *memory_map)
+{
+  uint32_t size = kheap_get_size(memory_map);
+  if (size < NUTSOS_HEAP_MIN_SIZE_BYTES) {
+    panic("Not enough memory for the kernel heap\n");
+  }
+
+  int total_table_entries = size / NUTSOS_HEAP_BLOCK_SIZE;
   kernel_heap_table.entries = (heap_block_table_entry_t *)NUTSOS_HEAP_TABLE_ADDRESS;
   kernel_heap_table.total = total_table_entries;
 
-  void *end = (void *)(NUTSOS_HEAP_ADDRESS + NUTSOS_HEAP_SIZE_BYTES);
+  void *end = (void *)(NUTSOS_HEAP_ADDRESS + size);
   int res = heap_create(&kernel_heap, (void *)(NUTSOS_HEAP_ADDRESS), end, &kernel_heap_table);
   if (res < 0) {
     print("Failed to create heap\n");
   }
+
+  kheap_init_slab_caches();
+
+  KHEAP_PROFILE(kheap_profile_init(&kernel_heap));
+}
+
+void *kheap_get_end()
+{
+  return kernel_heap.saddr + (kernel_heap_table.total * NUTSOS_HEAP_BLOCK_SIZE);
+}
+
+// Returns the smallest size class that can hold size bytes, or NULL if size is too big for slabs
+static struct slab_cache *kheap_get_slab_cache(size_t size)
+{
+  if (size > NUTSOS_HEAP_SLAB_MAX_SIZE) {
+    return 0;
+  }
+
+  size_t class_size = NUTSOS_HEAP_SLAB_MIN_SIZE;
+  int i = 0;
+  while (class_size < size) {
+    class_size <<= 1;
+    i++;
+  }
+
+  return &kernel_slab_caches[i];
 }
 
-void *kmalloc(size_t size)
+static void *kheap_malloc(size_t size)
 {
+  struct slab_cache *cache = kheap_get_slab_cache(size);
+  if (cache) {
+    return slab_cache_alloc(cache);
+  }
+
   return heap_malloc(&kernel_heap, size);
 }
 
+static void kheap_free(void *ptr)
+{
+  if (slab_is_object(ptr)) {
+    slab_free(ptr);
+    return;
+  }
+
+  heap_free(&kernel_heap, ptr);
+}
+
+// Allocations of NUTSOS_HEAP_BLOCK_SIZE bytes or more are always block aligned
+void *kmalloc(size_t size)
+{
+  void *ptr = kheap_malloc(size);
+  KHEAP_PROFILE(kheap_profile_alloc(ptr, size, __builtin_return_address(0)));
+  return ptr;
+}
+
 void *kzalloc(size_t size)
 {
-  void *ptr = kmalloc(size);
-  if (!ptr)
-    return 0;
+  void *ptr = 0;
+  struct slab_cache *cache = kheap_get_slab_cache(size);
+  if (!cache) {
+    ptr = heap_zalloc(&kernel_heap, size);
+  } else {
+    ptr = slab_cache_alloc(cache);
+    if (ptr) {
+      memset(ptr, 0x00, size);
+    }
+  }
 
-  memset(ptr, 0x00, size);
+  KHEAP_PROFILE(kheap_profile_alloc(ptr, size, __builtin_return_address(0)));
   return ptr;
 }
 
+int kheap_zero_free_blocks(int max_blocks)
+{
+  return heap_zero_free_blocks(&kernel_heap, max_blocks);
+}
+
+void *krealloc(void *ptr, size_t size)
+{
+  if (!ptr) {
+    ptr = kheap_malloc(size);
+    KHEAP_PROFILE(kheap_profile_alloc(ptr, size, __builtin_return_address(0)));
+    return ptr;
+  }
+
+  if (size == 0) {
+    KHEAP_PROFILE(kheap_profile_free(ptr));
+    kheap_free(ptr);
+    return 0;
+  }
+
+  size_t old_size = 0;
+  if (slab_is_object(ptr)) {
+    // Still the same size class, nothing to do
+    struct slab_cache *cache = slab_get_cache(ptr);
+    if (kheap_get_slab_cache(size) == cache) {
+      KHEAP_PROFILE(kheap_profile_resize(ptr, size));
+      return ptr;
+    }
+    old_size = cache->object_size;
+  } else {
+    // Try to grow or shrink the blocks in place, unless the new size is small enough for a slab
+    if (size > NUTSOS_HEAP_SLAB_MAX_SIZE && heap_resize(&kernel_heap, ptr, size) == 0) {
+      KHEAP_PROFILE(kheap_profile_resize(ptr, size));
+      return ptr;
+    }
+    old_size = heap_allocation_size(&kernel_heap, ptr);
+  }
+
+  // Fall back to allocate, copy and free
+  void *new_ptr = kheap_malloc(size);
+  if (!new_ptr) {
+    return 0;
+  }
+
+  memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+  KHEAP_PROFILE(kheap_profile_free(ptr));
+  KHEAP_PROFILE(kheap_profile_alloc(new_ptr, size, __builtin_return_address(0)));
+  kheap_free(ptr);
+  return new_ptr;
+}
+
 void kfree(void *ptr)
 {
-  heap_free(&kernel_heap, ptr);
-}
\ No newline at end of file
+  if (!ptr) {
+    return;
+  }
+
+  KHEAP_PROFILE(kheap_profile_free(ptr));
+  kheap_free(ptr);
+}
+
+void kheap_print_fragmentation()
+{
+  struct heap_fragmentation frag;
+  heap_get_fragmentation(&kernel_heap, &frag);
+
+  printf("[K] Heap: %u of %u blocks free in %u runs, largest run %u blocks\n",
+         frag.free_blocks,
+         kernel_heap_table.total,
+         frag.free_runs,
+         frag.largest_free_run);
+
+  print("[K] Free runs by size:");
+  for (int i = 0; i < HEAP_FRAGMENTATION_BUCKETS; i++) {
+    printf(" %u%s:%u", 1 << i, i == HEAP_FRAGMENTATION_BUCKETS - 1 ? "+" : "", frag.run_histogram[i]);
+  }
+  print("\n");
+
+  // One character per slice: '.' all free, '#' all taken, '+' partly free
+  char map[HEAP_FRAGMENTATION_MAP_SLICES + 1];
+  for (int i = 0; i < HEAP_FRAGMENTATION_MAP_SLICES; i++) {
+    size_t slice_blocks = (((i + 1) * kernel_heap_table.total) / HEAP_FRAGMENTATION_MAP_SLICES) -
+                          ((i * kernel_heap_table.total) / HEAP_FRAGMENTATION_MAP_SLICES);
+    if (frag.map[i] == 0) {
+      map[i] = '#';
+    } else if (frag.map[i] == slice_blocks) {
+      map[i] = '.';
+    } else {
+      map[i] = '+';
+    }
+  }
+  map[HEAP_FRAGMENTATION_MAP_SLICES] = 0;
+  printf("[K] Heap map: [%s]\n", map);
+
+#ifdef NUTSOS_HEAP_PROFILING
+  kheap_profile_dump();
+#endif
+}
@@ -4,9 +4,28 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void kheap_init();
+struct e820_map;
+
+// Create the kernel heap, sized after the usable RAM in memory_map
+void kheap_init(struct e820_map *memory_map);
+
+// Returns the first address past the end of the kernel heap
+void *kheap_get_end();
+
 void *kmalloc(size_t size);
 void *kzalloc(size_t size);
 void kfree(void *ptr);
 
+// Resize the allocation at ptr to size bytes, in place whenever possible.
+// Returns the (possibly moved) allocation or NULL on failure, in which case ptr is left untouched
+void *krealloc(void *ptr, size_t size);
+
+// Zero up to max_blocks free heap blocks ahead of time so that kzalloc can skip them,
+// returns how many blocks were zeroed
+int kheap_zero_free_blocks(int max_blocks);
+
+// Print the free runs of the kernel heap and a coarse map of where they are,
+// followed by the per-callsite accounting when NUTSOS_HEAP_PROFILING is enabled
+void kheap_print_fragmentation();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "kheap_profile.h"
+#include "cpu/cpu.h"
+#include "error.h"
+#include "heap.h"
+#include "memory/memory.h"
+#include "terminal/terminal.h"
+
+#ifdef NUTSOS_HEAP_PROFILING
+
+// Both table sizes are powers of two so that hashes can be masked
+#define KHEAP_PROFILE_CALLSITES_MASK   (NUTSOS_HEAP_PROFILE_CALLSITES - 1)
+#define KHEAP_PROFILE_ALLOCATIONS_MASK (NUTSOS_HEAP_PROFILE_ALLOCATIONS - 1)
+
+// Rates are reported per 2^20 cycles
+#define KHEAP_PROFILE_MCYCLES_SHIFT    20
+
+static struct kheap_profile_callsite *kheap_profile_callsites = 0;
+static struct kheap_profile_allocation *kheap_profile_allocations = 0;
+static uint32_t kheap_profile_dropped = 0;
+static uint32_t kheap_profile_tracked = 0;
+
+static uint32_t kheap_profile_hash(void *ptr)
+{
+  // Knuth's multiplicative hash, heap pointers are at least 16-byte aligned
+  return ((uint32_t)ptr >> 4) * 2654435761u;
+}
+
+int kheap_profile_init(struct heap *heap)
+{
+  kheap_profile_callsites = heap_zalloc(heap, NUTSOS_HEAP_PROFILE_CALLSITES * sizeof(struct kheap_profile_callsite));
+  kheap_profile_allocations = heap_zalloc(heap, NUTSOS_HEAP_PROFILE_ALLOCATIONS * sizeof(struct kheap_profile_allocation));
+  if (!kheap_profile_callsites || !kheap_profile_allocations) {
+    kheap_profile_callsites = 0;
+    kheap_profile_allocations = 0;
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+// Returns the index of the callsite of caller, adding it if it's not there yet. Returns -ENOMEM if the table is full
+static int kheap_profile_get_callsite(void *caller)
+{
+  uint32_t index = kheap_profile_hash(caller) & KHEAP_PROFILE_CALLSITES_MASK;
+  for (int i = 0; i < NUTSOS_HEAP_PROFILE_CALLSITES; i++) {
+    struct kheap_profile_callsite *callsite = &kheap_profile_callsites[index];
+    if (callsite->caller == caller) {
+      return index;
+    }
+
+    if (!callsite->caller) {
+      callsite->caller = caller;
+      return index;
+    }
+
+    index = (index + 1) & KHEAP_PROFILE_CALLSITES_MASK;
+  }
+
+  return -ENOMEM;
+}
+
+// Returns the slot holding ptr, or -EINVARG if ptr is not tracked
+static int kheap_profile_find_allocation(void *ptr)
+{
+  uint32_t index = kheap_profile_hash(ptr) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  for (int i = 0; i < NUTSOS_HEAP_PROFILE_ALLOCATIONS; i++) {
+    struct kheap_profile_allocation *allocation = &kheap_profile_allocations[index];
+    if (allocation->ptr == ptr) {
+      return index;
+    }
+
+    if (!allocation->ptr) {
+      break;
+    }
+
+    index = (index + 1) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  }
+
+  return -EINVARG;
+}
+
+// Empty a slot of the allocation table, moving back the entries that follow it in the same
+// probe sequence so that lookups never need tombstones
+static void kheap_profile_remove_allocation(uint32_t index)
+{
+  uint32_t hole = index;
+  uint32_t next = (index + 1) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  while (kheap_profile_allocations[next].ptr) {
+    uint32_t home = kheap_profile_hash(kheap_profile_allocations[next].ptr) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+
+    // The entry can fill the hole only if its home slot is not between the hole and itself
+    if (((next - home) & KHEAP_PROFILE_ALLOCATIONS_MASK) >= ((next - hole) & KHEAP_PROFILE_ALLOCATIONS_MASK)) {
+      kheap_profile_allocations[hole] = kheap_profile_allocations[next];
+      hole = next;
+    }
+
+    next = (next + 1) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  }
+
+  kheap_profile_allocations[hole].ptr = 0;
+  kheap_profile_tracked--;
+}
+
+void kheap_profile_alloc(void *ptr, size_t size, void *caller)
+{
+  if (!kheap_profile_allocations || !ptr) {
+    return;
+  }
+
+  int res = kheap_profile_get_callsite(caller);
+  if (ISERR(res)) {
+    kheap_profile_dropped++;
+    return;
+  }
+
+  uint64_t now = cpu_read_tsc();
+  struct kheap_profile_callsite *callsite = &kheap_profile_callsites[res];
+  if (callsite->allocations == 0) {
+    callsite->first_tsc = now;
+  }
+  callsite->last_tsc = now;
+  callsite->allocations++;
+  callsite->total_bytes += size;
+
+  // One slot always stays empty: it ends the probe sequences of the lookups and removals
+  if (kheap_profile_tracked == NUTSOS_HEAP_PROFILE_ALLOCATIONS - 1) {
+    kheap_profile_dropped++;
+    return;
+  }
+
+  uint32_t index = kheap_profile_hash(ptr) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  for (int i = 0; i < NUTSOS_HEAP_PROFILE_ALLOCATIONS; i++) {
+    struct kheap_profile_allocation *allocation = &kheap_profile_allocations[index];
+    if (!allocation->ptr) {
+      allocation->ptr = ptr;
+      allocation->size = size;
+      allocation->callsite = res;
+      allocation->tsc = now;
+      callsite->live_allocations++;
+      callsite->live_bytes += size;
+      kheap_profile_tracked++;
+      return;
+    }
+
+    index = (index + 1) & KHEAP_PROFILE_ALLOCATIONS_MASK;
+  }
+
+  kheap_profile_dropped++;
+}
+
+void kheap_profile_resize(void *ptr, size_t size)
+{
+  if (!kheap_profile_allocations) {
+    return;
+  }
+
+  int res = kheap_profile_find_allocation(ptr);
+  if (ISERR(res)) {
+    return;
+  }
+
+  struct kheap_profile_allocation *allocation = &kheap_profile_allocations[res];
+  struct kheap_profile_callsite *callsite = &kheap_profile_callsites[allocation->callsite];
+  callsite->live_bytes = callsite->live_bytes - allocation->size + size;
+  allocation->size = size;
+}
+
+void kheap_profile_free(void *ptr)
+{
+  if (!kheap_profile_allocations || !ptr) {
+    return;
+  }
+
+  int res = kheap_profile_find_allocation(ptr);
+  if (ISERR(res)) {
+    return;
+  }
+
+  struct kheap_profile_allocation *allocation = &kheap_profile_allocations[res];
+  struct kheap_profile_callsite *callsite = &kheap_profile_callsites[allocation->callsite];
+  callsite->frees++;
+  callsite->live_allocations--;
+  callsite->live_bytes -= allocation->size;
+
+  kheap_profile_remove_allocation(res);
+}
+
+// Returns the timestamp of the oldest allocation from callsite that is still live
+static uint64_t kheap_profile_oldest_live(uint32_t callsite, uint64_t now)
+{
+  uint64_t oldest = now;
+  for (int i = 0; i < NUTSOS_HEAP_PROFILE_ALLOCATIONS; i++) {
+    struct kheap_profile_allocation *allocation = &kheap_profile_allocations[i];
+    if (allocation->ptr && allocation->callsite == callsite && allocation->tsc < oldest) {
+      oldest = allocation->tsc;
+    }
+  }
+
+  return oldest;
+}
+
+void kheap_profile_dump()
+{
+  if (!kheap_profile_allocations) {
+    print("[K] Heap profiling is not running\n");
+    return;
+  }
+
+  uint64_t now = cpu_read_tsc();
+  print("[K] Heap callsites (rate in allocations per 2^20 cycles, age in 2^20 cycles):\n");
+  for (int i = 0; i < NUTSOS_HEAP_PROFILE_CALLSITES; i++) {
+    struct kheap_profile_callsite *callsite = &kheap_profile_callsites[i];
+    if (!callsite->caller) {
+      continue;
+    }
+
+    uint32_t span = (uint32_t)((callsite->last_tsc - callsite->first_tsc) >> KHEAP_PROFILE_MCYCLES_SHIFT);
+    uint32_t rate = span ? callsite->allocations / span : callsite->allocations;
+    printf("  %x: %u bytes live in %u allocs, %u allocs %u frees, rate %u",
+           (uint32_t)callsite->caller,
+           callsite->live_bytes,
+           callsite->live_allocations,
+           callsite->allocations,
+           callsite->frees,
+           rate);
+
+    if (callsite->live_allocations) {
+      uint32_t age = (uint32_t)((now - kheap_profile_oldest_live(i, now)) >> KHEAP_PROFILE_MCYCLES_SHIFT);
+      printf(", oldest live %u", age);
+    }
+    print("\n");
+  }
+
+  if (kheap_profile_dropped) {
+    printf("[K] %u heap allocations were not tracked (profiling tables full)\n", kheap_profile_dropped);
+  }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef KHEAP_PROFILE_H
+#define KHEAP_PROFILE_H
+
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel heap profiling (see NUTSOS_HEAP_PROFILING in config.h).
+// Every kmalloc/kzalloc/krealloc/kfree is recorded with its caller, size and timestamp:
+// - callsites are accounted in a table indexed by caller address (live bytes, allocations, frees, rate)
+// - live allocations are kept in a hash table indexed by pointer, so that frees find their callsite
+// Both tables are allocated straight from the kernel heap when profiling starts and never grow,
+// whatever doesn't fit is counted as dropped.
+
+#ifdef NUTSOS_HEAP_PROFILING
+
+struct heap;
+
+struct kheap_profile_callsite {
+  void *caller;
+  uint32_t allocations;
+  uint32_t frees;
+  uint32_t live_allocations;
+  uint32_t live_bytes;
+  uint32_t total_bytes;
+
+  // Timestamps of the first and the last allocation from this callsite
+  uint64_t first_tsc;
+  uint64_t last_tsc;
+};
+
+struct kheap_profile_allocation {
+  void *ptr;
+  uint32_t size;
+  uint32_t callsite;
+  uint64_t tsc;
+};
+
+// Set up the profiling tables, carving them from heap
+int kheap_profile_init(struct heap *heap);
+
+// Record the allocation of size bytes at ptr requested by caller (NULL allocations are ignored)
+void kheap_profile_alloc(void *ptr, size_t size, void *caller);
+
+// Record an allocation resized in place
+void kheap_profile_resize(void *ptr, size_t size);
+
+// Record the release of ptr, pointers allocated before profiling started are ignored
+void kheap_profile_free(void *ptr);
+
+// Print the live bytes and allocation rate of every callsite
+void kheap_profile_dump();
+
+#endif
+
+#endif
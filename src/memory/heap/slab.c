@@ -0,0 +1,131 @@
+#include "slab.h"
+#include "config.h"
+#include "error.h"
+
+static struct slab *slab_from_object(void *ptr)
+{
+  return (struct slab *)((uint32_t)ptr - ((uint32_t)ptr % NUTSOS_HEAP_BLOCK_SIZE));
+}
+
+static void *slab_object_at(struct slab *slab, int index)
+{
+  return (void *)slab + SLAB_HEADER_SIZE + (index * slab->cache->object_size);
+}
+
+static void slab_list_insert(struct slab_cache *cache, struct slab *slab)
+{
+  slab->prev = 0;
+  slab->next = cache->partial;
+  if (cache->partial) {
+    cache->partial->prev = slab;
+  }
+  cache->partial = slab;
+}
+
+static void slab_list_remove(struct slab_cache *cache, struct slab *slab)
+{
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    cache->partial = slab->next;
+  }
+
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+
+  slab->next = 0;
+  slab->prev = 0;
+}
+
+int slab_cache_init(struct slab_cache *cache, struct heap *heap, size_t object_size)
+{
+  // Objects need to be big enough to hold the free list pointer and at least one has to fit in a block
+  if (object_size < sizeof(void *) || object_size > NUTSOS_HEAP_BLOCK_SIZE - SLAB_HEADER_SIZE) {
+    return -EINVARG;
+  }
+
+  cache->heap = heap;
+  cache->object_size = object_size;
+  cache->objects_per_slab = (NUTSOS_HEAP_BLOCK_SIZE - SLAB_HEADER_SIZE) / object_size;
+  cache->partial = 0;
+
+  return 0;
+}
+
+// Take a block from the heap and chain all its objects in the free list
+static struct slab *slab_new(struct slab_cache *cache)
+{
+  struct slab *slab = heap_malloc(cache->heap, NUTSOS_HEAP_BLOCK_SIZE);
+  if (!slab) {
+    return 0;
+  }
+
+  slab->cache = cache;
+  slab->next = 0;
+  slab->prev = 0;
+  slab->free_count = cache->objects_per_slab;
+
+  for (int i = 0; i < cache->objects_per_slab - 1; i++) {
+    *(void **)slab_object_at(slab, i) = slab_object_at(slab, i + 1);
+  }
+  *(void **)slab_object_at(slab, cache->objects_per_slab - 1) = 0;
+  slab->free_list = slab_object_at(slab, 0);
+
+  return slab;
+}
+
+void *slab_cache_alloc(struct slab_cache *cache)
+{
+  struct slab *slab = cache->partial;
+  if (!slab) {
+    slab = slab_new(cache);
+    if (!slab) {
+      return 0;
+    }
+    slab_list_insert(cache, slab);
+  }
+
+  void *object = slab->free_list;
+  slab->free_list = *(void **)object;
+  slab->free_count--;
+
+  // The slab is now full, stop tracking it until one of its objects is freed
+  if (slab->free_count == 0) {
+    slab_list_remove(cache, slab);
+  }
+
+  return object;
+}
+
+void slab_free(void *ptr)
+{
+  struct slab *slab = slab_from_object(ptr);
+  struct slab_cache *cache = slab->cache;
+
+  *(void **)ptr = slab->free_list;
+  slab->free_list = ptr;
+  slab->free_count++;
+
+  // The slab was full, it can serve allocations again
+  if (slab->free_count == 1) {
+    slab_list_insert(cache, slab);
+  }
+
+  // Give completely free slabs back to the heap, but keep the last one around
+  // so that a single alloc/free pattern doesn't keep hitting the heap
+  if (slab->free_count == cache->objects_per_slab && (slab->next || slab->prev)) {
+    slab_list_remove(cache, slab);
+    heap_free(cache->heap, slab);
+  }
+}
+
+struct slab_cache *slab_get_cache(void *ptr)
+{
+  return slab_from_object(ptr)->cache;
+}
+
+bool slab_is_object(void *ptr)
+{
+  return ((uint32_t)ptr % NUTSOS_HEAP_BLOCK_SIZE) != 0;
+}
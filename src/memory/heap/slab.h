@@ -0,0 +1,60 @@
+#ifndef SLAB_H
+#define SLAB_H
+#include "heap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A slab is a single heap block carved into equally sized objects.
+// The slab header sits at the beginning of the block and the objects follow it,
+// free objects are chained together through their first word.
+// 0                  SLAB_HEADER_SIZE                                   4096
+// | struct slab ...  | obj 0 | obj 1 | obj 2 | ...              | unused |
+// As objects never start at the beginning of a block, a pointer that is not
+// block-aligned always belongs to a slab and its header can be found by simply
+// aligning the pointer down to NUTSOS_HEAP_BLOCK_SIZE.
+
+#define SLAB_HEADER_SIZE 32
+
+struct slab_cache;
+
+struct slab {
+  // The cache this slab belongs to
+  struct slab_cache *cache;
+
+  // Linked list of slabs with at least one free object
+  struct slab *next;
+  struct slab *prev;
+
+  // First free object in the slab
+  void *free_list;
+  uint16_t free_count;
+};
+
+struct slab_cache {
+  // The heap the slabs are carved from
+  struct heap *heap;
+
+  size_t object_size;
+  uint16_t objects_per_slab;
+
+  // Slabs with at least one free object (full slabs are not tracked)
+  struct slab *partial;
+};
+
+// Initialise a cache of object_size objects, carving slabs from heap
+int slab_cache_init(struct slab_cache *cache, struct heap *heap, size_t object_size);
+
+// Allocate an object from the cache
+void *slab_cache_alloc(struct slab_cache *cache);
+
+// Free an object previously allocated from any slab cache
+void slab_free(void *ptr);
+
+// Returns the cache ptr has been allocated from
+struct slab_cache *slab_get_cache(void *ptr);
+
+// Returns true if ptr points inside a slab rather than being a block allocation
+bool slab_is_object(void *ptr);
+
+#endif
@@ -0,0 +1,232 @@
+[BITS 32]
+
+section .asm
+
+global memory_set_rep
+global memory_copy_rep
+global memory_copy_backward
+global memory_set_sse2
+global memory_copy_sse2
+
+; Below this many bytes aligning the destination isn't worth it and everything is done one byte at a time
+MEMORY_REP_THRESHOLD  equ 16
+; Below this many bytes the SSE2 variants don't pay for saving and restoring the xmm registers
+MEMORY_SSE2_THRESHOLD equ 128
+
+; void *memory_set_rep(void *ptr, uint8_t c, size_t size)
+; Byte stores until ptr is 4-byte aligned, then rep stosd and the remaining bytes
+memory_set_rep:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edi, [ebp+8]
+    movzx eax, byte [ebp+12]
+    imul eax, eax, 0x01010101
+    mov edx, [ebp+16]
+    cld
+
+    cmp edx, MEMORY_REP_THRESHOLD
+    jb .tail
+
+    mov ecx, edi
+    neg ecx
+    and ecx, 3
+    sub edx, ecx
+    rep stosb
+
+    mov ecx, edx
+    shr ecx, 2
+    rep stosd
+    and edx, 3
+
+.tail:
+    mov ecx, edx
+    rep stosb
+
+    mov eax, [ebp+8]
+    pop edi
+    pop ebp
+    ret
+
+; void memory_copy_rep(void *dest, const void *src, size_t count)
+; Byte copies until dest is 4-byte aligned, then rep movsd and the remaining bytes.
+; Copies forward, so it's safe for overlapping buffers only if dest is below src
+memory_copy_rep:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov edx, [ebp+16]
+    cld
+
+    cmp edx, MEMORY_REP_THRESHOLD
+    jb .tail
+
+    mov ecx, edi
+    neg ecx
+    and ecx, 3
+    sub edx, ecx
+    rep movsb
+
+    mov ecx, edx
+    shr ecx, 2
+    rep movsd
+    and edx, 3
+
+.tail:
+    mov ecx, edx
+    rep movsb
+
+    pop edi
+    pop esi
+    pop ebp
+    ret
+
+; void memory_copy_backward(void *dest, const void *src, size_t count)
+; Copies from the last byte down to the first, for overlapping buffers where dest is above src
+memory_copy_backward:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov edx, [ebp+16]
+    lea edi, [edi+edx-1]
+    lea esi, [esi+edx-1]
+    std
+
+    ; The odd bytes at the end first, then whole words
+    mov ecx, edx
+    and ecx, 3
+    rep movsb
+
+    sub esi, 3
+    sub edi, 3
+    mov ecx, edx
+    shr ecx, 2
+    rep movsd
+
+    cld
+    pop edi
+    pop esi
+    pop ebp
+    ret
+
+; void *memory_set_sse2(void *ptr, uint8_t c, size_t size)
+; Byte stores until ptr is 16-byte aligned, then 64 bytes per iteration with aligned SSE2 stores.
+; xmm0 is saved and restored as the kernel doesn't preserve the SSE state of the interrupted code
+memory_set_sse2:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edi, [ebp+8]
+    movzx eax, byte [ebp+12]
+    imul eax, eax, 0x01010101
+    mov edx, [ebp+16]
+    cld
+
+    cmp edx, MEMORY_SSE2_THRESHOLD
+    jb .tail
+
+    mov ecx, edi
+    neg ecx
+    and ecx, 15
+    sub edx, ecx
+    rep stosb
+
+    sub esp, 16
+    movdqu [esp], xmm0
+    movd xmm0, eax
+    pshufd xmm0, xmm0, 0
+
+    mov ecx, edx
+    shr ecx, 6
+.loop:
+    movdqa [edi], xmm0
+    movdqa [edi+16], xmm0
+    movdqa [edi+32], xmm0
+    movdqa [edi+48], xmm0
+    add edi, 64
+    dec ecx
+    jnz .loop
+
+    movdqu xmm0, [esp]
+    add esp, 16
+    and edx, 63
+
+.tail:
+    mov ecx, edx
+    rep stosb
+
+    mov eax, [ebp+8]
+    pop edi
+    pop ebp
+    ret
+
+; void memory_copy_sse2(void *dest, const void *src, size_t count)
+; Byte copies until dest is 16-byte aligned, then 64 bytes per iteration with unaligned SSE2 loads
+; and aligned stores. Same overlap rules as memory_copy_rep, xmm0-xmm3 are saved and restored
+memory_copy_sse2:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov edx, [ebp+16]
+    cld
+
+    cmp edx, MEMORY_SSE2_THRESHOLD
+    jb .tail
+
+    mov ecx, edi
+    neg ecx
+    and ecx, 15
+    sub edx, ecx
+    rep movsb
+
+    sub esp, 64
+    movdqu [esp], xmm0
+    movdqu [esp+16], xmm1
+    movdqu [esp+32], xmm2
+    movdqu [esp+48], xmm3
+
+    mov ecx, edx
+    shr ecx, 6
+.loop:
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi+16]
+    movdqu xmm2, [esi+32]
+    movdqu xmm3, [esi+48]
+    movdqa [edi], xmm0
+    movdqa [edi+16], xmm1
+    movdqa [edi+32], xmm2
+    movdqa [edi+48], xmm3
+    add esi, 64
+    add edi, 64
+    dec ecx
+    jnz .loop
+
+    movdqu xmm0, [esp]
+    movdqu xmm1, [esp+16]
+    movdqu xmm2, [esp+32]
+    movdqu xmm3, [esp+48]
+    add esp, 64
+    and edx, 63
+
+.tail:
+    mov ecx, edx
+    rep movsb
+
+    pop edi
+    pop esi
+    pop ebp
+    ret
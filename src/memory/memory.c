@@ -1,34 +1,67 @@
 #include "memory.h"
+#include "cpu/cpu.h"
 
-void *memset(void *ptr, uint8_t c, size_t size)
+// rep stosd/movsd work on any CPU so they are the default until memory_init finds something better
+static void *(*memory_set_impl)(void *ptr, uint8_t c, size_t size) = memory_set_rep;
+static void (*memory_copy_impl)(void *dest, const void *src, size_t count) = memory_copy_rep;
+
+void memory_init()
 {
-  uint8_t *c_ptr = (uint8_t *)ptr;
-  for (int i = 0; i < size; i++) {
-    c_ptr[i] = c;
+  struct cpu_id id;
+  cpu_cpuid(1, &id);
+  if (id.edx & CPU_FEATURE_EDX_SSE2) {
+    cpu_enable_sse();
+    memory_set_impl = memory_set_sse2;
+    memory_copy_impl = memory_copy_sse2;
   }
-  return ptr;
+}
+
+void *memset(void *ptr, uint8_t c, size_t size)
+{
+  return memory_set_impl(ptr, c, size);
 }
 
 int memcmp(const void *s1, const void *s2, int count)
 {
-  unsigned char *t1 = (unsigned char *)s1;
-  unsigned char *t2 = (unsigned char *)s2;
-  while (count-- && *t1 == *t2) {
+  const unsigned char *t1 = (const unsigned char *)s1;
+  const unsigned char *t2 = (const unsigned char *)s2;
+
+  // Skip the equal words, then look for the first difference one byte at a time
+  while (count >= 4 && *(const uint32_t *)t1 == *(const uint32_t *)t2) {
+    t1 += 4;
+    t2 += 4;
+    count -= 4;
+  }
+
+  while (count > 0) {
+    if (*t1 != *t2) {
+      return *t1 - *t2;
+    }
     t1++;
     t2++;
-  }
-  if (count == -1) {
-    return 0;
+    count--;
   }
 
-  return *t2 - *t1;
+  return 0;
 }
 
 void memcpy(const void *s1, const void *s2, int count)
 {
-  unsigned char *t1 = (unsigned char *)s1;
-  unsigned char *t2 = (unsigned char *)s2;
-  while (count--) {
-    *t1++ = *t2++;
+  if (count > 0) {
+    memory_copy_impl((void *)s1, s2, count);
+  }
+}
+
+void memmove(void *dest, const void *src, int count)
+{
+  if (count <= 0 || dest == src) {
+    return;
+  }
+
+  // Copying forward is only a problem when dest starts inside src
+  if (dest < src || dest >= src + count) {
+    memory_copy_impl(dest, src, count);
+  } else {
+    memory_copy_backward(dest, src, count);
   }
 }
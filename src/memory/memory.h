@@ -4,7 +4,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Pick the fastest memset/memcpy implementation for this CPU (see memory_set_impl in memory.c)
+void memory_init();
+
 void *memset(void *ptr, uint8_t c, size_t size);
 int memcmp(const void *s1, const void *s2, int count);
 void memcpy(const void *s1, const void *s2, int count);
+// Like memcpy, but the two buffers are allowed to overlap
+void memmove(void *dest, const void *src, int count);
+
+// Defined in memory.asm, the implementations memset and memcpy dispatch to
+void *memory_set_rep(void *ptr, uint8_t c, size_t size);
+void memory_copy_rep(void *dest, const void *src, size_t count);
+void memory_copy_backward(void *dest, const void *src, size_t count);
+void *memory_set_sse2(void *ptr, uint8_t c, size_t size);
+void memory_copy_sse2(void *dest, const void *src, size_t count);
 #endif
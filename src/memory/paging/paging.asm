@@ -4,6 +4,7 @@ section .asm
 
 global paging_load_directory
 global enable_paging
+global paging_invalidate_page
 
 ; To load the paging directory all is needed is to set CR3 to the address of the page directory
 paging_load_directory:
@@ -17,11 +18,21 @@ paging_load_directory:
 ; Enabling paging is actually very simple. 
 ; All that is needed is to set the paging (PG) bit of CR0. 
 ; Note: setting the paging flag when the protection flag is clear causes a general-protection exception.
+; Write protect (WP) is set as well, so that the kernel faults too when writing to a read-only (copy-on-write) user page
 enable_paging:
     push ebp
     mov ebp, esp
     mov eax, cr0
-    or eax, 0x80000000
+    or eax, 0x80010000
     mov cr0, eax
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+; Drop the TLB entry translating the virtual address passed as argument (global ones included)
+paging_invalidate_page:
+    push ebp
+    mov ebp, esp
+    mov eax, [ebp+8]
+    invlpg [eax]
+    pop ebp
+    ret
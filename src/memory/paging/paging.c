@@ -1,6 +1,11 @@
 #include "paging.h"
+#include "cpu/cpu.h"
+#include "config.h"
 #include "error.h"
+#include "kernel.h"
+#include "memory/frame/frame.h"
 #include "memory/heap/kheap.h"
+#include "memory/memory.h"
 
 // A entry in either the directory table or the entry table consists of 8 bits of flags
 // followed by a 24 4096-byte aligned pointer.
@@ -22,60 +27,297 @@
 // D, or the Dirty flag, if set, indicates that page has been written to.
 // 0, if PAT is supported, shall indicate the memory type. Otherwise, it must be 0.
 
-#define PAGING_ENTRY_GET_POINTER(entry)      ((void *)((uint32_t)(entry)&0xFFFFF000))
-#define PAGING_ENTRY_SET_FLAGS(entry, flags) ((uint32_t)(entry) | (flags))
-#define PAGING_ENTRY_GET_FLAGS(entry)        ((uint32_t)(entry)&0x00000FFF)
+// With PAE the entries are twice as wide (64 bits): the address takes bits 12 to 51 and bit 63 is the
+// no-execute flag, while a large page is 2 MiB.
+// see https://wiki.osdev.org/Page_Tables#PAE
+
+// Address of the large page pointed by a large directory entry
+#define PAGING_LARGE_ENTRY_GET_ADDRESS(entry) \
+  ((paging_phys)((entry)&PAGING_ENTRY_ADDRESS_MASK & ~(paging_entry)(PAGING_TABLE_SPAN - 1)))
+
+// Flags a large directory entry and the page table entries it is split into have in common
+#define PAGING_LARGE_ENTRY_PAGE_FLAGS \
+  (PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL | PAGING_WRITE_THROUGH | PAGING_CACHE_DISABLED | PAGING_IS_GLOBAL | \
+   PAGING_NO_EXECUTE)
+
+// Above this many pages a full TLB flush is cheaper than invalidating them one by one
+#define PAGING_INVALIDATE_MAX_PAGES 32
+
+#ifdef NUTSOS_PAGING_PAE
+// Bytes of address space covered by each page directory (one per page directory pointer table entry)
+#define PAGING_DIRECTORY_SPAN (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_TABLE_SPAN)
+
+// Read by the boot trampoline in kernel.asm (before paging is on) to pick the kind of tables it builds
+const uint32_t paging_boot_pae = 1;
+#else
+const uint32_t paging_boot_pae = 0;
+#endif
 
 // Defined in paging.asm
-extern void paging_load_directory(paging_dir *directory);
+extern void paging_load_directory(uint32_t directory);
+extern void paging_invalidate_page(void *virt);
 
 // Pointer to the directory in use
 static paging_dir *current_directory = 0;
 
-struct paging_chunk *paging_chunk_new(int dir_entries, int page_entries, uint8_t flags)
+// The directory whose tables are shared by every other chunk (the kernel's), changes made to it
+// can show up in whatever directory is in use
+static paging_dir *shared_directory = 0;
+
+// End of the RAM mapped in the kernel half of every chunk
+static uint32_t paging_ram_end = 0;
+
+// True if the CPU supports 4 MiB (global) pages and they have been turned on
+static bool paging_large_pages = false;
+static bool paging_global_pages = false;
+
+// Flags the CPU doesn't support (no-execute without EFER.NXE), dropped from every page descriptor set
+static paging_entry paging_unsupported_flags = PAGING_NO_EXECUTE;
+
+#ifdef NUTSOS_PAGING_PAE
+// Page table of the kmap window, the same in every chunk
+static paging_entry *paging_kmap_table = 0;
+
+// Turn on no-execute pages if the CPU has them and create the page table of the kmap window
+static void paging_init_pae()
+{
+  struct cpu_id id;
+  cpu_cpuid(CPU_EXTENDED_LEAVES, &id);
+  if (id.eax >= CPU_EXTENDED_FEATURES) {
+    cpu_cpuid(CPU_EXTENDED_FEATURES, &id);
+    if (id.edx & CPU_EXTENDED_FEATURE_EDX_NX) {
+      cpu_write_msr(CPU_MSR_EFER, cpu_read_msr(CPU_MSR_EFER) | CPU_EFER_NXE);
+      paging_unsupported_flags = 0;
+    }
+  }
+
+  paging_kmap_table = frame_zalloc();
+  if (!paging_kmap_table) {
+    panic("Failed to create the kmap window\n");
+  }
+}
+#endif
+
+void paging_init(uint32_t ram_end)
+{
+  paging_ram_end = ram_end;
+
+  struct cpu_id id;
+  cpu_cpuid(1, &id);
+#ifdef NUTSOS_PAGING_PAE
+  // 2 MiB pages come with PAE, CR4.PSE only matters for the 32 bit tables
+  paging_large_pages = true;
+  paging_init_pae();
+#else
+  if (id.edx & CPU_FEATURE_EDX_PSE) {
+    cpu_write_cr4(cpu_read_cr4() | CPU_CR4_PSE);
+    paging_large_pages = true;
+  }
+#endif
+
+  if (id.edx & CPU_FEATURE_EDX_PGE) {
+    cpu_write_cr4(cpu_read_cr4() | CPU_CR4_PGE);
+    paging_global_pages = true;
+  }
+}
+
+// Returns the directory entry for the PAGING_TABLE_SPAN at index. With PAE the directory is a page directory
+// pointer table, each of its entries points to the page directory holding PAGING_TOTAL_ENTRIES_PER_TABLE
+// of the entries (they're always there, see paging_chunk_new)
+static paging_entry *paging_get_directory_entry(paging_dir *directory, uint32_t index)
+{
+#ifdef NUTSOS_PAGING_PAE
+  paging_entry *page_directory = PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(directory[index / PAGING_TOTAL_ENTRIES_PER_TABLE]));
+  return &page_directory[index % PAGING_TOTAL_ENTRIES_PER_TABLE];
+#else
+  return &directory[index];
+#endif
+}
+
+// Fill table with the 4 KiB pages making up the large page of a large directory entry
+static void paging_split_large_entry(paging_entry *table, paging_entry entry)
+{
+  paging_phys base = PAGING_LARGE_ENTRY_GET_ADDRESS(entry);
+  paging_entry flags = entry & PAGING_LARGE_ENTRY_PAGE_FLAGS;
+  for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++) {
+    table[b] = PAGING_ENTRY_SET_FLAGS(base + (b * PAGING_PAGE_SIZE), flags);
+  }
+}
+
+// Returns the page table for directory_index ready to be changed: an empty one is created if it's
+// not there yet, a large page is split in a table of 4 KiB pages and a table shared with another
+// chunk is replaced by a private copy
+static paging_entry *paging_get_table(paging_dir *directory, uint32_t directory_index)
+{
+  paging_entry *directory_entry = paging_get_directory_entry(directory, directory_index);
+  paging_entry entry = *directory_entry;
+  if ((entry & PAGING_IS_PRESENT) && !(entry & (PAGING_IS_SHARED | PAGING_IS_LARGE))) {
+    return PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(entry));
+  }
+
+  paging_entry *table = 0;
+  if ((entry & PAGING_IS_PRESENT) && (entry & PAGING_IS_LARGE)) {
+    table = frame_alloc();
+    if (table) {
+      paging_split_large_entry(table, entry);
+    }
+  } else if (entry & PAGING_IS_SHARED) {
+    table = frame_alloc();
+    if (table) {
+      memcpy(table, PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(entry)), PAGING_PAGE_SIZE);
+    }
+  } else {
+    table = frame_zalloc();
+  }
+
+  if (!table) {
+    return 0;
+  }
+
+  *directory_entry = PAGING_ENTRY_SET_FLAGS(PAGING_VIRT_TO_PHYS(table), PAGING_DIRECTORY_FLAGS);
+  return table;
+}
+
+struct paging_chunk *paging_chunk_new(uint8_t flags)
 {
-  // Alloc a full directory of entries
-  uint32_t *directory = kzalloc(sizeof(paging_dir) * dir_entries);
+  // Directories and tables are exactly one page each and come from the frame allocator
+  paging_dir *directory = frame_zalloc();
+  if (!directory) {
+    return 0;
+  }
+
+  struct paging_chunk *chunk = kzalloc(sizeof(struct paging_chunk));
+  if (!chunk) {
+    frame_free(directory);
+    return 0;
+  }
+  chunk->directory_entry = directory;
 
-  // For each one of these, populate the entry and assign it to the directory
-  int offset = 0;
-  for (int i = 0; i < dir_entries; i++) {
-    paging_entry *entry = kzalloc(sizeof(paging_entry) * page_entries);
+#ifdef NUTSOS_PAGING_PAE
+  // Every page directory is there from the start, the pointer table entries only take the present bit
+  for (int i = 0; i < PAGING_TOTAL_POINTER_ENTRIES; i++) {
+    paging_entry *page_directory = frame_zalloc();
+    if (!page_directory) {
+      paging_chunk_free(chunk);
+      return 0;
+    }
+    directory[i] = PAGING_ENTRY_SET_FLAGS(PAGING_VIRT_TO_PHYS(page_directory), PAGING_IS_PRESENT);
+  }
 
-    // For each entry in the entry table, calculate the real memory it points to.
-    // In this case we assign linearly, meaning that virt address 0xXX will map to real address 0xXX
-    for (int b = 0; b < page_entries; b++) {
-      entry[b] = (offset + (b * PAGING_PAGE_SIZE)) | flags;
+  // The kmap window doesn't belong to any chunk
+  *paging_get_directory_entry(directory, NUTSOS_KERNEL_KMAP_ADDRESS / PAGING_TABLE_SPAN) =
+    PAGING_ENTRY_SET_FLAGS(PAGING_VIRT_TO_PHYS(paging_kmap_table), PAGING_DIRECTORY_FLAGS | PAGING_IS_SHARED);
+#endif
+
+  // Map the RAM at NUTSOS_KERNEL_VIRTUAL_BASE, meaning that virt address 0xXX will map to real address
+  // 0xXX - NUTSOS_KERNEL_VIRTUAL_BASE. Every entry of these tables is written below, no need for zeroed frames
+  uint32_t first = NUTSOS_KERNEL_VIRTUAL_BASE / PAGING_TABLE_SPAN;
+  for (uint32_t i = 0; first + i < PAGING_TOTAL_DIR_ENTRIES && i * PAGING_TABLE_SPAN < paging_ram_end; i++) {
+    // Tasks never remap anything in the kernel half, its translations can survive address space switches
+    paging_entry page_flags = flags;
+    if (paging_global_pages) {
+      page_flags |= PAGING_IS_GLOBAL;
     }
-    // Move the offset to the beginning of the next entry table
-    offset += (page_entries * PAGING_PAGE_SIZE);
 
-    // Assign the directory entry (remember the format contains a pointer + flags)
-    directory[i] = (uint32_t)entry | (flags | PAGING_IS_WRITEABLE);
+    // A single large page does it, mapping a bit past the end of the RAM doesn't matter
+    paging_entry *directory_entry = paging_get_directory_entry(directory, first + i);
+    if (paging_large_pages) {
+      *directory_entry = PAGING_ENTRY_SET_FLAGS(i * PAGING_TABLE_SPAN, page_flags | PAGING_IS_LARGE);
+      continue;
+    }
+
+    paging_entry *table = frame_alloc();
+    if (!table) {
+      paging_chunk_free(chunk);
+      return 0;
+    }
+
+    uint32_t offset = i * PAGING_TABLE_SPAN;
+    for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++) {
+      uint32_t addr = offset + (b * PAGING_PAGE_SIZE);
+      table[b] = addr < paging_ram_end ? PAGING_ENTRY_SET_FLAGS(addr, page_flags) : 0;
+    }
+
+    *directory_entry = PAGING_ENTRY_SET_FLAGS(PAGING_VIRT_TO_PHYS(table), PAGING_DIRECTORY_FLAGS);
+  }
+
+  return chunk;
+}
+
+struct paging_chunk *paging_chunk_new_shared(struct paging_chunk *parent)
+{
+  paging_dir *directory = frame_zalloc();
+  if (!directory) {
+    return 0;
   }
 
   struct paging_chunk *chunk = kzalloc(sizeof(struct paging_chunk));
+  if (!chunk) {
+    frame_free(directory);
+    return 0;
+  }
   chunk->directory_entry = directory;
-  chunk->dir_count = dir_entries;
-  chunk->entries_count = page_entries;
+  shared_directory = parent->directory_entry;
+
+#ifdef NUTSOS_PAGING_PAE
+  // The kernel half is a page directory of its own (NUTSOS_USER_SPACE_END is 1 GiB aligned), shared as a whole
+  for (int i = 0; i < PAGING_TOTAL_POINTER_ENTRIES; i++) {
+    if (i >= NUTSOS_USER_SPACE_END / PAGING_DIRECTORY_SPAN) {
+      directory[i] = parent->directory_entry[i] | PAGING_IS_SHARED;
+      continue;
+    }
+
+    paging_entry *page_directory = frame_zalloc();
+    if (!page_directory) {
+      paging_chunk_free(chunk);
+      return 0;
+    }
+    directory[i] = PAGING_ENTRY_SET_FLAGS(PAGING_VIRT_TO_PHYS(page_directory), PAGING_IS_PRESENT);
+  }
+#else
+  // Only the kernel half is shared, the user space starts out empty
+  for (int i = NUTSOS_USER_SPACE_END / PAGING_TABLE_SPAN; i < PAGING_TOTAL_DIR_ENTRIES; i++) {
+    paging_entry entry = parent->directory_entry[i];
+    directory[i] = (entry & PAGING_IS_PRESENT) ? entry | PAGING_IS_SHARED : 0;
+  }
+#endif
 
   return chunk;
 }
 
 void paging_chunk_free(struct paging_chunk *chunk)
 {
+  paging_dir *directory = chunk->directory_entry;
   for (int i = 0; i < PAGING_TOTAL_DIR_ENTRIES; i++) {
-    uint32_t entry = chunk->directory_entry[i];
-    kfree(PAGING_ENTRY_GET_POINTER(entry));
+#ifdef NUTSOS_PAGING_PAE
+    // Skip the page directories that are shared or missing (the chunk was only partly created)
+    paging_entry pointer = directory[i / PAGING_TOTAL_ENTRIES_PER_TABLE];
+    if (!(pointer & PAGING_IS_PRESENT) || (pointer & PAGING_IS_SHARED)) {
+      continue;
+    }
+#endif
+
+    paging_entry entry = *paging_get_directory_entry(directory, i);
+    if ((entry & PAGING_IS_PRESENT) && !(entry & (PAGING_IS_SHARED | PAGING_IS_LARGE))) {
+      frame_free(PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(entry)));
+    }
+  }
+
+#ifdef NUTSOS_PAGING_PAE
+  for (int i = 0; i < PAGING_TOTAL_POINTER_ENTRIES; i++) {
+    if ((directory[i] & PAGING_IS_PRESENT) && !(directory[i] & PAGING_IS_SHARED)) {
+      frame_free(PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(directory[i])));
+    }
   }
+#endif
 
-  kfree(chunk->directory_entry);
+  frame_free(directory);
   kfree(chunk);
 }
 
 void paging_switch(paging_dir *directory)
 {
-  paging_load_directory(directory);
+  paging_load_directory(PAGING_VIRT_TO_PHYS(directory));
   current_directory = directory;
 }
 
@@ -100,33 +342,41 @@ void *paging_align_address(void *ptr)
   return ptr;
 }
 
-// Maps a single page phys to virt address on a dir (with flags)
-// Addresses need to be page aligned
-int paging_map(uint32_t *directory, void *virt, void *phys, int flags)
+// Returns true if changes to directory can be cached in the TLB right now
+static bool paging_is_in_use(paging_dir *directory)
 {
-  // Make sure addresses are aligned
-  if (!paging_is_aligned(virt) || !paging_is_aligned(phys)) {
-    return -EINVARG;
+  return current_directory && (directory == current_directory || directory == shared_directory);
+}
+
+// Flush the whole TLB, including the global pages (toggling CR4.PGE drops every entry)
+static void paging_flush_tlb()
+{
+  if (paging_global_pages) {
+    uint32_t cr4 = cpu_read_cr4();
+    cpu_write_cr4(cr4 & ~CPU_CR4_PGE);
+    cpu_write_cr4(cr4);
+    return;
   }
 
-  return paging_set(directory, virt, PAGING_ENTRY_SET_FLAGS(phys, flags));
+  paging_load_directory(PAGING_VIRT_TO_PHYS(current_directory));
 }
 
-// Maps count phys addresses to virt addresses
+// Returns true if the physical address phys is aligned to PAGING_PAGE_SIZE
+static bool paging_is_phys_aligned(paging_phys phys)
+{
+  return (phys & (PAGING_PAGE_SIZE - 1)) == 0;
+}
+
+// Maps a single page phys to virt address on a dir (with flags)
 // Addresses need to be page aligned
-int paging_map_range(uint32_t *directory, void *virt, void *phys, int count, int flags)
+int paging_map(paging_dir *directory, void *virt, paging_phys phys, paging_entry flags)
 {
-  int res = 0;
-  for (int i = 0; i < count; i++) {
-    res = paging_map(directory, virt, phys, flags);
-    if (ISERR(res)) {
-      break;
-    }
-    virt += PAGING_PAGE_SIZE;
-    phys += PAGING_PAGE_SIZE;
+  // Make sure addresses are aligned
+  if (!paging_is_aligned(virt) || !paging_is_phys_aligned(phys)) {
+    return -EINVARG;
   }
 
-  return res;
+  return paging_set(directory, virt, PAGING_ENTRY_SET_FLAGS(phys, flags));
 }
 
 // Get page directory and entry relative to virtual_address (must be PAGE_SIZE aligned)
@@ -143,8 +393,35 @@ int paging_get_indexes(void *virtual_address, uint32_t *directory_index_out, uin
   return res;
 }
 
-// Set page descriptor for the page related to address virt in directory
-int paging_set(paging_dir *directory, void *virt, paging_entry pdesc)
+bool paging_is_table_present(paging_dir *directory, void *virt)
+{
+  return *paging_get_directory_entry(directory, (uint32_t)virt / PAGING_TABLE_SPAN) & PAGING_IS_PRESENT;
+}
+
+paging_entry paging_get(paging_dir *directory, void *virt)
+{
+  uint32_t directory_index = 0;
+  uint32_t table_index = 0;
+  if (paging_get_indexes(virt, &directory_index, &table_index) < 0) {
+    return 0;
+  }
+
+  paging_entry entry = *paging_get_directory_entry(directory, directory_index);
+  if (!(entry & PAGING_IS_PRESENT)) {
+    return 0;
+  }
+
+  if (entry & PAGING_IS_LARGE) {
+    paging_phys addr = PAGING_LARGE_ENTRY_GET_ADDRESS(entry) + (table_index * PAGING_PAGE_SIZE);
+    return PAGING_ENTRY_SET_FLAGS(addr, entry & PAGING_LARGE_ENTRY_PAGE_FLAGS);
+  }
+
+  paging_entry *table = PAGING_PHYS_TO_VIRT(PAGING_ENTRY_GET_ADDRESS(entry));
+  return table[table_index];
+}
+
+// Set the page descriptor of virt in directory, leaving the TLB alone
+static int paging_set_entry(paging_dir *directory, void *virt, paging_entry pdesc)
 {
   if (!paging_is_aligned(virt)) {
     return -EINVARG;
@@ -157,25 +434,68 @@ int paging_set(paging_dir *directory, void *virt, paging_entry pdesc)
     return res;
   }
 
-  // Grab the entry in the table directory
-  uint32_t entry = directory[directory_index];
-  // Extract the entry-table pointer from the entry
-  uint32_t *table = PAGING_ENTRY_GET_POINTER(entry);
+  // Grab the page table from the directory, tables are only created when a page in them is first set
+  paging_entry *table = paging_get_table(directory, directory_index);
+  if (!table) {
+    return -ENOMEM;
+  }
+
   // Set the new value
-  table[table_index] = pdesc;
+  table[table_index] = pdesc & ~paging_unsupported_flags;
 
   return 0;
 }
 
-int paging_map_to(uint32_t *directory, void *virt, void *phys, void *phys_end, int flags)
+// Set page descriptor for the page related to address virt in directory
+int paging_set(paging_dir *directory, void *virt, paging_entry pdesc)
+{
+  int res = paging_set_entry(directory, virt, pdesc);
+  if (res == 0 && paging_is_in_use(directory)) {
+    // Also drops the whole large page translation if a large page has just been split
+    paging_invalidate_page(virt);
+  }
+
+  return res;
+}
+
+// Maps count phys addresses to virt addresses
+// Addresses need to be page aligned
+int paging_map_range(paging_dir *directory, void *virt, paging_phys phys, int count, paging_entry flags)
+{
+  if (!paging_is_aligned(virt) || !paging_is_phys_aligned(phys)) {
+    return -EINVARG;
+  }
+
+  // Small ranges invalidate their pages one by one through paging_set, big ones flush the TLB once at the end
+  bool flush = count > PAGING_INVALIDATE_MAX_PAGES && paging_is_in_use(directory);
+
+  int res = 0;
+  for (int i = 0; i < count; i++) {
+    paging_entry pdesc = PAGING_ENTRY_SET_FLAGS(phys, flags);
+    res = flush ? paging_set_entry(directory, virt, pdesc) : paging_set(directory, virt, pdesc);
+    if (ISERR(res)) {
+      break;
+    }
+    virt += PAGING_PAGE_SIZE;
+    phys += PAGING_PAGE_SIZE;
+  }
+
+  if (flush) {
+    paging_flush_tlb();
+  }
+
+  return res;
+}
+
+int paging_map_to(paging_dir *directory, void *virt, paging_phys phys, paging_phys phys_end, paging_entry flags)
 {
   // Make sure addresses are page aligned
-  if ((uint32_t)virt % PAGING_PAGE_SIZE || (uint32_t)phys % PAGING_PAGE_SIZE || (uint32_t)phys_end % PAGING_PAGE_SIZE) {
+  if (!paging_is_aligned(virt) || !paging_is_phys_aligned(phys) || !paging_is_phys_aligned(phys_end)) {
     return -EINVARG;
   }
 
   // Make sure the physical address interval is positive
-  if ((uint32_t)phys_end < (uint32_t)phys) {
+  if (phys_end < phys) {
     return -EINVARG;
   }
 
@@ -183,4 +503,27 @@ int paging_map_to(uint32_t *directory, void *virt, void *phys, void *phys_end, i
   int total_pages = total_bytes / PAGING_PAGE_SIZE;
 
   return paging_map_range(directory, virt, phys, total_pages, flags);
-}
\ No newline at end of file
+}
+
+void *paging_kmap(int slot, paging_phys phys)
+{
+  if (phys < NUTSOS_KERNEL_DIRECT_MAP_SIZE) {
+    return PAGING_PHYS_TO_VIRT(phys);
+  }
+
+#ifdef NUTSOS_PAGING_PAE
+  if (slot < 0 || slot >= NUTSOS_KERNEL_KMAP_SLOTS) {
+    panic("Invalid kmap slot\n");
+  }
+
+  // The window is shared by every chunk, so whatever the directory in use a single invlpg does it
+  void *virt = (void *)(NUTSOS_KERNEL_KMAP_ADDRESS + (slot * PAGING_PAGE_SIZE));
+  paging_entry flags = PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_NO_EXECUTE;
+  paging_kmap_table[slot] = PAGING_ENTRY_SET_FLAGS(phys, flags & ~paging_unsupported_flags);
+  paging_invalidate_page(virt);
+  return virt;
+#else
+  panic("Frame outside of the kernel mapping of the RAM\n");
+  return 0;
+#endif
+}
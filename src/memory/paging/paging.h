@@ -1,47 +1,128 @@
 #ifndef PAGING_H
 #define PAGING_H
 
+#include "config.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+// Available to the OS (ignored by the CPU): the page is not present as it's been written to swap, the
+// entry holds the swap slot in place of the address (and the flags the page had)
+#define PAGING_IS_SWAPPED              0b100000000000
+
+// Available to the OS (ignored by the CPU): the page is shared read-only with another address space
+// and gets copied on the first write
+#define PAGING_IS_COPY_ON_WRITE        0b10000000000
+
+// Available to the OS (ignored by the CPU): the directory entry points to a page table owned by
+// another chunk (the kernel's) and must not be modified or freed through this one
+#define PAGING_IS_SHARED               0b1000000000
+
+// The translation is kept in the TLB when CR3 is reloaded (needs CR4.PGE), only for mappings that
+// are the same in every address space
+#define PAGING_IS_GLOBAL               0b100000000
+
+// Directory entries only: the entry maps a whole PAGING_TABLE_SPAN page rather than pointing to a page table
+#define PAGING_IS_LARGE                0b10000000
+// Set by the CPU when the page is accessed
+#define PAGING_IS_ACCESSED             0b00100000
 #define PAGING_CACHE_DISABLED          0b00010000
 #define PAGING_WRITE_THROUGH           0b00001000
 #define PAGING_ACCESS_FROM_ALL         0b00000100
 #define PAGING_IS_WRITEABLE            0b00000010
 #define PAGING_IS_PRESENT              0b00000001
 
+#ifdef NUTSOS_PAGING_PAE
+// PAE: entries are 64 bits wide, so a table only holds 512 of them. The directory of a chunk is a page directory
+// pointer table of 4 entries, each pointing to a page directory covering 1 GiB. The 4 page directories are
+// indexed as a single one of 2048 entries (see paging_get_directory_entry)
+// reference: https://wiki.osdev.org/Page_Tables#PAE
+#define PAGING_TOTAL_DIR_ENTRIES       2048
+#define PAGING_TOTAL_ENTRIES_PER_TABLE 512
+#define PAGING_TOTAL_POINTER_ENTRIES   4
+
+// Instruction fetches from the page fault (needs EFER.NXE, dropped from the entries if the CPU doesn't support it)
+#define PAGING_NO_EXECUTE              (1ULL << 63)
+#define PAGING_ENTRY_ADDRESS_MASK      0x000FFFFFFFFFF000ULL
+
+typedef uint64_t paging_entry;
+typedef uint64_t paging_dir;
+typedef uint64_t paging_phys;
+#else
 // Defining a directroy of 1024 entry, each with 1024 location describing 4k each, we manage to cover 4GB of RAM
 // reference: https://wiki.osdev.org/Paging
 #define PAGING_TOTAL_DIR_ENTRIES       1024
 #define PAGING_TOTAL_ENTRIES_PER_TABLE 1024
-#define PAGING_PAGE_SIZE               4096
+
+// Not available without PAE, every page can be executed
+#define PAGING_NO_EXECUTE              0
+#define PAGING_ENTRY_ADDRESS_MASK      0xFFFFF000
 
 typedef uint32_t paging_entry;
 typedef uint32_t paging_dir;
+typedef uint32_t paging_phys;
+#endif
+
+#define PAGING_PAGE_SIZE               4096
+
+// Bytes of address space covered by each page table
+#define PAGING_TABLE_SPAN              (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE)
+
+// Flags of the directory entries, the page table entries are the ones restricting access
+#define PAGING_DIRECTORY_FLAGS         (PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL)
+
+// Page descriptors hold physical addresses, while the kernel reaches the RAM through its mapping at
+// NUTSOS_KERNEL_VIRTUAL_BASE (the same in every address space). Only addresses below
+// NUTSOS_KERNEL_DIRECT_MAP_SIZE are mapped there, see paging_kmap for the others
+#define PAGING_PHYS_TO_VIRT(phys)            ((void *)((uint32_t)(phys) + NUTSOS_KERNEL_VIRTUAL_BASE))
+#define PAGING_VIRT_TO_PHYS(virt)            ((paging_phys)((uint32_t)(virt)-NUTSOS_KERNEL_VIRTUAL_BASE))
+
+#define PAGING_ENTRY_GET_ADDRESS(entry)      ((paging_phys)((entry)&PAGING_ENTRY_ADDRESS_MASK))
+#define PAGING_ENTRY_SET_FLAGS(entry, flags) ((paging_entry)(entry) | (flags))
+#define PAGING_ENTRY_GET_FLAGS(entry)        ((paging_entry)(entry) & ~(paging_entry)PAGING_ENTRY_ADDRESS_MASK)
 
 struct paging_chunk {
   paging_dir *directory_entry;
-  int dir_count;
-  int entries_count;
 };
 
-// Creates a new paging directory containing dir_entries entries, each with
-// page_entries describing PAGING_PAGE_SIZE bytes of RAM
-struct paging_chunk *paging_chunk_new(int dir_entries, int page_entries, uint8_t flags);
+// Set the end of the RAM (physical) mapped at NUTSOS_KERNEL_VIRTUAL_BASE by the kernel chunk and turn
+// on large (4 MiB, 2 MiB with PAE), global and no-execute pages if the CPU supports them.
+// Needs to be called before creating any chunk
+void paging_init(uint32_t ram_end);
+
+// Creates a new paging directory mapping the RAM at NUTSOS_KERNEL_VIRTUAL_BASE with flags (meant for the
+// kernel chunk), the user space below is left empty. The RAM is mapped with global large pages when
+// available (no page tables at all), 4 KiB pages otherwise.
+// Any other page table is created on demand by paging_set
+struct paging_chunk *paging_chunk_new(uint8_t flags);
 
-// Delete a paging chunk
+// Creates a new paging directory sharing the kernel half of parent (the kernel chunk), with an empty
+// user space. A shared table is only copied to one owned by the new chunk the first time paging_set
+// changes one of its pages. Changes made by the parent to the shared tables show up in the new chunk as well.
+// With PAE the whole page directory of the kernel half is shared instead, and it's never copied
+struct paging_chunk *paging_chunk_new_shared(struct paging_chunk *parent);
+
+// Delete a paging chunk and all of the page tables it owns
 void paging_chunk_free(struct paging_chunk *chunk);
 
-// Switches the paging directory in use
+// Switches the paging directory in use (a pointer in the kernel mapping, like every directory)
 void paging_switch(paging_dir *directory);
 
 // Enable paging on the CPU
 void enable_paging();
 
-// Sets a page for a specific virtual address (PAGING_PAGE_SIZE aligned)
+// Sets a page for a specific virtual address (PAGING_PAGE_SIZE aligned), the page table is created
+// if needed (splitting a large page in 4 KiB ones). Returns -ENOMEM if it can't be allocated
 int paging_set(paging_dir *directory, void *virt, paging_entry pdesc);
 
+// Returns true if directory has a page table (or a large page) for the PAGING_TABLE_SPAN holding virt,
+// meant to skip the empty parts of the address space when walking it
+bool paging_is_table_present(paging_dir *directory, void *virt);
+
+// Returns the page descriptor for virt (PAGING_PAGE_SIZE aligned) in directory, 0 if there's no page
+// table for it. For a large page the descriptor of the 4 KiB page it would be split in is returned
+paging_entry paging_get(paging_dir *directory, void *virt);
+
 // Returns true if addr is aligned to PAGING_PAGE_SIZE
 bool paging_is_aligned(void *addr);
 void *paging_align_address(void *ptr);
@@ -50,13 +131,19 @@ void *paging_align_address(void *ptr);
 paging_dir *paging_chunk_get_directory(struct paging_chunk *chunk);
 
 
-int paging_map_to(uint32_t *directory, void *virt, void *phys, void *phys_end, int flags);
+int paging_map_to(paging_dir *directory, void *virt, paging_phys phys, paging_phys phys_end, paging_entry flags);
 
 // Map count pages virt->phys with flags (page aligned)
-int paging_map_range(uint32_t *directory, void *virt, void *phys, int count, int flags);
+int paging_map_range(paging_dir *directory, void *virt, paging_phys phys, int count, paging_entry flags);
+
+// Map a single page virt->phys with flags (page aligned), phys is a physical address (see PAGING_VIRT_TO_PHYS)
+int paging_map(paging_dir *directory, void *virt, paging_phys phys, paging_entry flags);
 
-// Map a single page virt->phys with flags (page aligned)
-int paging_map(uint32_t *directory, void *virt, void *phys, int flags);
+// Returns a pointer the kernel can access the frame at phys through. Frames of the RAM mapped at
+// NUTSOS_KERNEL_VIRTUAL_BASE are returned straight away, the others (only with PAE) are mapped in slot
+// (0 to NUTSOS_KERNEL_KMAP_SLOTS - 1) of the window at NUTSOS_KERNEL_KMAP_ADDRESS, replacing whatever
+// the slot held before
+void *paging_kmap(int slot, paging_phys phys);
 
 // Align ptr to the next page
 void *paging_align_address(void *ptr);
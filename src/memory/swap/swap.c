@@ -0,0 +1,97 @@
+#include "swap.h"
+#include "config.h"
+#include "disk/disk.h"
+#include "error.h"
+#include "kernel.h"
+#include "memory/heap/kheap.h"
+
+#define SWAP_SECTORS_PER_SLOT (PAGING_PAGE_SIZE / NUTSOS_SECTOR_SIZE)
+#define SWAP_TOTAL_SLOTS      (NUTSOS_SWAP_SIZE_BYTES / PAGING_PAGE_SIZE)
+
+// The disk holding the swap area, NULL until swap_init
+static struct disk *swap_disk = 0;
+
+// Number of owners of each slot, 0 when it's free
+static uint8_t *swap_slots = 0;
+
+// Where to start looking for a free slot, right after the last one taken
+static uint32_t swap_next_slot = 0;
+
+int swap_init(struct disk *disk)
+{
+  if (!disk || SWAP_TOTAL_SLOTS == 0) {
+    return -EINVARG;
+  }
+
+  swap_slots = kzalloc(SWAP_TOTAL_SLOTS);
+  if (!swap_slots) {
+    return -ENOMEM;
+  }
+
+  swap_disk = disk;
+  return 0;
+}
+
+static unsigned int swap_get_sector(uint32_t slot)
+{
+  return NUTSOS_SWAP_START_SECTOR + (slot * SWAP_SECTORS_PER_SLOT);
+}
+
+// Panics if slot is not a slot in use
+static void swap_check_slot(uint32_t slot)
+{
+  if (!swap_disk || slot >= SWAP_TOTAL_SLOTS || !swap_slots[slot]) {
+    panic("Not a swap slot in use\n");
+  }
+}
+
+int swap_out(paging_phys frame)
+{
+  if (!swap_disk) {
+    return -ENOMEM;
+  }
+
+  uint32_t slot = swap_next_slot;
+  for (uint32_t i = 0; i < SWAP_TOTAL_SLOTS; i++, slot++) {
+    if (slot == SWAP_TOTAL_SLOTS) {
+      slot = 0;
+    }
+
+    if (swap_slots[slot]) {
+      continue;
+    }
+
+    int res = disk_write_block(swap_disk, swap_get_sector(slot), SWAP_SECTORS_PER_SLOT, paging_kmap(0, frame));
+    if (ISERR(res)) {
+      return res;
+    }
+
+    swap_slots[slot] = 1;
+    swap_next_slot = slot + 1;
+    return slot;
+  }
+
+  return -ENOMEM;
+}
+
+int swap_in(uint32_t slot, paging_phys frame)
+{
+  swap_check_slot(slot);
+  return disk_read_block(swap_disk, swap_get_sector(slot), SWAP_SECTORS_PER_SLOT, paging_kmap(0, frame));
+}
+
+void swap_ref(uint32_t slot)
+{
+  swap_check_slot(slot);
+  if (swap_slots[slot] == UINT8_MAX) {
+    panic("Too many references to a swap slot\n");
+  }
+
+  swap_slots[slot]++;
+}
+
+void swap_free(uint32_t slot)
+{
+  swap_check_slot(slot);
+  swap_slots[slot]--;
+}
@@ -0,0 +1,30 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "memory/paging/paging.h"
+#include <stdint.h>
+
+// Swap area for user pages, NUTSOS_SWAP_SIZE_BYTES of disk from NUTSOS_SWAP_START_SECTOR on.
+// The area is split in page sized slots, each with a reference count (0 when the slot is free) as a
+// swapped out page is shared by all the address spaces that had it copy-on-write.
+// The page table entries of a swapped out page hold its slot, see PAGING_IS_SWAPPED
+
+struct disk;
+
+// Start swapping to disk, returns -EINVARG if the swap area is turned off (NUTSOS_SWAP_SIZE_BYTES is 0)
+int swap_init(struct disk *disk);
+
+// Write the frame at phys to a free slot (through kmap slot 0) owned by a single address space.
+// Returns the slot, -ENOMEM if the swap area is full
+int swap_out(paging_phys frame);
+
+// Read slot back in the frame at phys (through kmap slot 0), the slot keeps its owners
+int swap_in(uint32_t slot, paging_phys frame);
+
+// Add an owner to a slot in use, it then takes one more swap_free to release it
+void swap_ref(uint32_t slot);
+
+// Drop one of the owners of a slot, it's free again once they're all gone
+void swap_free(uint32_t slot);
+
+#endif
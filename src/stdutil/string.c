@@ -13,6 +13,11 @@
 #define ASCII_A     65
 #define ASCII_Z     90
 
+// Word-at-a-time helpers: strings are read 4 bytes at a time once the pointers are 4-byte aligned,
+// so a read never crosses a page boundary past the terminator
+#define STRING_WORD_SIZE  4
+#define STRING_WORD_ONES  0x01010101
+#define STRING_WORD_HIGHS 0x80808080
 
 bool isdigit(char c)
 {
@@ -24,9 +29,44 @@ bool isspace(char c)
   return c == ASCII_SPACE || (c >= ASCII_HTAB && c <= ASCII_CR);
 }
 
+static bool string_is_aligned(const void *ptr)
+{
+  return ((uint32_t)ptr % STRING_WORD_SIZE) == 0;
+}
+
+// Non-zero if any of the 4 bytes of word is 0
+static uint32_t string_word_has_zero(uint32_t word)
+{
+  return (word - STRING_WORD_ONES) & ~word & STRING_WORD_HIGHS;
+}
+
+// tolower on the 4 bytes of word at once: the high bit of each byte of ge_a (gt_z) is set
+// if the byte is at least 'A' (more than 'Z'), bytes with their own high bit set are never letters
+static uint32_t string_word_tolower(uint32_t word)
+{
+  uint32_t low7 = word & ~STRING_WORD_HIGHS;
+  uint32_t ge_a = low7 + ((0x80 - ASCII_A) * STRING_WORD_ONES);
+  uint32_t gt_z = low7 + ((0x80 - ASCII_Z - 1) * STRING_WORD_ONES);
+  uint32_t is_upper = ge_a & ~gt_z & ~word & STRING_WORD_HIGHS;
+
+  // 0x80 >> 2 is the 0x20 that turns an upper case letter to lower case
+  return word | (is_upper >> 2);
+}
+
 size_t strlen(const char *str)
 {
   size_t len = 0;
+  while (!string_is_aligned(str + len)) {
+    if (!str[len]) {
+      return len;
+    }
+    len++;
+  }
+
+  while (!string_word_has_zero(*(const uint32_t *)(str + len))) {
+    len += STRING_WORD_SIZE;
+  }
+
   while (str[len]) {
     len++;
   }
@@ -37,6 +77,17 @@ size_t strlen(const char *str)
 size_t strnlen(const char *str, size_t max)
 {
   size_t len = 0;
+  while (len < max && !string_is_aligned(str + len)) {
+    if (!str[len]) {
+      return len;
+    }
+    len++;
+  }
+
+  while (len + STRING_WORD_SIZE <= max && !string_word_has_zero(*(const uint32_t *)(str + len))) {
+    len += STRING_WORD_SIZE;
+  }
+
   while (str[len] && len < max) {
     len++;
   }
@@ -59,6 +110,27 @@ size_t strnlent(const char *str, int max, char term)
 
 int istrncmp(const char *s1, const char *s2, int n)
 {
+  // Compare whole words while they match and have no terminator, the byte loop
+  // finds the actual difference. Only possible if both strings can be aligned at once
+  if (((uint32_t)s1 % STRING_WORD_SIZE) == ((uint32_t)s2 % STRING_WORD_SIZE)) {
+    while (n > 0 && !string_is_aligned(s1) && *s1 && (tolower(*s1) == tolower(*s2))) {
+      s1++;
+      s2++;
+      n--;
+    }
+
+    while (n >= STRING_WORD_SIZE && string_is_aligned(s1)) {
+      uint32_t w1 = *(const uint32_t *)s1;
+      uint32_t w2 = *(const uint32_t *)s2;
+      if (string_word_has_zero(w1) || string_word_tolower(w1) != string_word_tolower(w2)) {
+        break;
+      }
+      s1 += STRING_WORD_SIZE;
+      s2 += STRING_WORD_SIZE;
+      n -= STRING_WORD_SIZE;
+    }
+  }
+
   while (n-- && *s1 && (tolower(*s1) == tolower(*s2))) {
     s1++;
     s2++;
@@ -75,6 +147,25 @@ int istrncmp(const char *s1, const char *s2, int n)
 
 int strncmp(const char *s1, const char *s2, int n)
 {
+  // Same as istrncmp, skip the equal words first
+  if (((uint32_t)s1 % STRING_WORD_SIZE) == ((uint32_t)s2 % STRING_WORD_SIZE)) {
+    while (n > 0 && !string_is_aligned(s1) && *s1 && (*s1 == *s2)) {
+      s1++;
+      s2++;
+      n--;
+    }
+
+    while (n >= STRING_WORD_SIZE && string_is_aligned(s1)) {
+      uint32_t w1 = *(const uint32_t *)s1;
+      if (string_word_has_zero(w1) || w1 != *(const uint32_t *)s2) {
+        break;
+      }
+      s1 += STRING_WORD_SIZE;
+      s2 += STRING_WORD_SIZE;
+      n -= STRING_WORD_SIZE;
+    }
+  }
+
   while (n-- && *s1 && (*s1 == *s2)) {
     s1++;
     s2++;
@@ -89,8 +180,24 @@ int strncmp(const char *s1, const char *s2, int n)
   return (*(unsigned char *)s1 - *(unsigned char *)s2);
 }
 
+// Returns the address right past the terminator copied to dest
 char *strcpy(char *dest, const char *src)
 {
+  while (!string_is_aligned(src)) {
+    if ((*(dest++) = *(src++)) == ASCII_TERM) {
+      return dest;
+    }
+  }
+
+  // Copy whole words up to the one holding the terminator
+  uint32_t word = *(const uint32_t *)src;
+  while (!string_word_has_zero(word)) {
+    *(uint32_t *)dest = word;
+    dest += STRING_WORD_SIZE;
+    src += STRING_WORD_SIZE;
+    word = *(const uint32_t *)src;
+  }
+
   while ((*(dest++) = *(src++)) != ASCII_TERM) {}
   return dest;
 }
@@ -101,6 +208,26 @@ char *strncpy(char *dest, const char *src, int size)
   return dest;
 }
 
+// Convert value to a nil-terminated string in base (2 to 16)
+char *utoa(uint32_t value, char *out, int base)
+{
+  char tmp[33];
+  int i = 0;
+  do {
+    int digit = value % base;
+    tmp[i++] = digit < 10 ? ASCII_ZERO + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value);
+
+  char *ptr = out;
+  while (i) {
+    *ptr++ = tmp[--i];
+  }
+  *ptr = ASCII_TERM;
+
+  return out;
+}
+
 char tolower(char s)
 {
   s = (s >= ASCII_A && s <= ASCII_Z) ? (s + 32) : s;
@@ -2,6 +2,7 @@
 #define STRING_H
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 size_t strlen(const char *str);
 size_t strnlen(const char *str, size_t max);
@@ -15,6 +16,7 @@ bool isspace(char c);
 bool isdigit(char c);
 
 int ctoi(char c);
+char *utoa(uint32_t value, char *out, int base);
 char tolower(char s);
 
 char *ltrim(char *s);
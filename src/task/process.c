@@ -2,10 +2,14 @@
 #include "config.h"
 #include "error.h"
 #include "fs/file.h"
+#include "fs/file_mapping.h"
+#include "idt/idt.h"
 #include "kernel.h"
+#include "memory/frame/frame.h"
 #include "memory/heap/kheap.h"
 #include "memory/memory.h"
 #include "memory/paging/paging.h"
+#include "memory/swap/swap.h"
 #include "stdutil/string.h"
 #include "task/task.h"
 
@@ -15,6 +19,89 @@ struct process *current_process = 0;
 
 static struct process *processes[NUTSOS_MAX_PROCESSES] = {};
 
+// Hand of the clock picking the user pages to swap out: a process slot and an address in its user space
+static int process_clock_slot = 0;
+static uint32_t process_clock_addr = 0;
+
+static uint32_t process_next_page(paging_dir *directory, uint32_t addr, uint32_t end);
+
+// Returns true if entry maps one of the pages of the process (user space only holds those)
+static bool process_is_user_page(paging_entry entry)
+{
+  return (entry & PAGING_IS_PRESENT) && (entry & PAGING_ACCESS_FROM_ALL);
+}
+
+static uint32_t process_get_swap_slot(paging_entry entry)
+{
+  return PAGING_ENTRY_GET_ADDRESS(entry) / PAGING_PAGE_SIZE;
+}
+
+// Write the page mapped by entry at page to swap and give its frame back
+static int process_swap_out(struct process *process, void *page, paging_entry entry)
+{
+  int slot = swap_out(PAGING_ENTRY_GET_ADDRESS(entry));
+  if (slot < 0) {
+    return slot;
+  }
+
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  paging_entry flags = (PAGING_ENTRY_GET_FLAGS(entry) & ~PAGING_IS_PRESENT) | PAGING_IS_SWAPPED;
+  int res = paging_set(directory, page, PAGING_ENTRY_SET_FLAGS((paging_phys)slot * PAGING_PAGE_SIZE, flags));
+  if (ISERR(res)) {
+    swap_free(slot);
+    return res;
+  }
+
+  frame_phys_free(PAGING_ENTRY_GET_ADDRESS(entry));
+  return 0;
+}
+
+// Swap out one user page, picked with the clock algorithm: the hand sweeps the user pages of every process
+// and the ones accessed since it last went by only get their accessed bit cleared. Only the private pages
+// are picked, as the other owners of a shared one would keep it in memory anyway.
+// Returns -ENOMEM if there's nothing left to swap out
+static int process_evict_page()
+{
+  // Two full turns at most, the first one could be all about clearing accessed bits
+  for (int visits = 0; visits <= 2 * NUTSOS_MAX_PROCESSES; visits++) {
+    struct process *process = processes[process_clock_slot];
+    if (process && process->task) {
+      paging_dir *directory = process->task->page_directory->directory_entry;
+      uint32_t addr = process_next_page(directory, process_clock_addr, NUTSOS_USER_SPACE_END);
+      for (; addr < NUTSOS_USER_SPACE_END; addr = process_next_page(directory, addr + PAGING_PAGE_SIZE, NUTSOS_USER_SPACE_END)) {
+        paging_entry entry = paging_get(directory, (void *)addr);
+        if (!process_is_user_page(entry) || frame_phys_get_refs(PAGING_ENTRY_GET_ADDRESS(entry)) != 1) {
+          continue;
+        }
+
+        if (entry & PAGING_IS_ACCESSED) {
+          paging_set(directory, (void *)addr, entry & ~PAGING_IS_ACCESSED);
+          continue;
+        }
+
+        process_clock_addr = addr + PAGING_PAGE_SIZE;
+        return process_swap_out(process, (void *)addr, entry);
+      }
+    }
+
+    process_clock_slot = (process_clock_slot + 1) % NUTSOS_MAX_PROCESSES;
+    process_clock_addr = 0;
+  }
+
+  return -ENOMEM;
+}
+
+// Allocate a frame for a user page (zero-filled if zero is set), swapping other pages out if there's none left
+static paging_phys process_alloc_user_frame(bool zero)
+{
+  paging_phys frame = zero ? frame_user_zalloc() : frame_user_alloc();
+  while (!frame && process_evict_page() == 0) {
+    frame = zero ? frame_user_zalloc() : frame_user_alloc();
+  }
+
+  return frame;
+}
+
 static int process_load_for_slot(const char *filename, struct process **out, int process_slot);
 
 static void process_init(struct process *process)
@@ -31,6 +118,7 @@ struct process *process_get(int process_id)
   return processes[process_id];
 }
 
+// Read the program image straight into freshly allocated frames, one page at a time
 static int process_load_binary(const char *filename, struct process *process)
 {
   int res = 0;
@@ -46,18 +134,39 @@ static int process_load_binary(const char *filename, struct process *process)
     goto out;
   }
 
-  void *program_data_ptr = kzalloc(stat.filesize);
-  if (!program_data_ptr) {
+  uint32_t frame_count = (uint32_t)paging_align_address((void *)stat.filesize) / PAGING_PAGE_SIZE;
+  void **frames = kzalloc(frame_count * sizeof(void *));
+  if (!frames) {
     res = -ENOMEM;
     goto out;
   }
 
-  if (fread(program_data_ptr, stat.filesize, 1, fd->index) != 1) {
-    res = -EIO;
+  res = frame_alloc_batch(frames, frame_count);
+  while (res == -ENOMEM && process_evict_page() == 0) {
+    res = frame_alloc_batch(frames, frame_count);
+  }
+
+  if (ISERR(res)) {
+    kfree(frames);
     goto out;
   }
 
-  process->ptr = program_data_ptr;
+  for (uint32_t i = 0; i < frame_count; i++) {
+    uint32_t offset = i * PAGING_PAGE_SIZE;
+    uint32_t total = stat.filesize - offset < PAGING_PAGE_SIZE ? stat.filesize - offset : PAGING_PAGE_SIZE;
+
+    // Zero the part of the last page past the end of the file
+    memset(frames[i] + total, 0x00, PAGING_PAGE_SIZE - total);
+    if (fseek(fd->index, offset, SEEK_SET) != EOK || fread(frames[i], total, 1, fd->index) != 1) {
+      frame_free_batch(frames, frame_count);
+      kfree(frames);
+      res = -EIO;
+      goto out;
+    }
+  }
+
+  process->image_frames = frames;
+  process->image_frame_count = frame_count;
   process->size = stat.filesize;
   process->ptr_virt = (uint32_t *)NUTSOS_PROGRAM_VIRTUAL_ADDRESS;
 
@@ -73,13 +182,45 @@ static int process_load_data(const char *filename, struct process *process)
   return res;
 }
 
+// Map frames one page after the other starting at virt
+static int process_map_frames(struct process *process, void *virt, void **frames, int count)
+{
+  int res = 0;
+  // Past the user space the mappings are the kernel's, shared with every task
+  if ((uint32_t)virt + (count * PAGING_PAGE_SIZE) > NUTSOS_USER_SPACE_END) {
+    return -EINVARG;
+  }
+
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  for (int i = 0; i < count; i++) {
+    res = paging_map(directory,
+                     virt + (i * PAGING_PAGE_SIZE),
+                     PAGING_VIRT_TO_PHYS(frames[i]),
+                     PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITEABLE);
+    if (ISERR(res)) {
+      // Leave all the frames to the caller
+      while (i--) {
+        paging_set(directory, virt + (i * PAGING_PAGE_SIZE), 0);
+      }
+      break;
+    }
+  }
+
+  return res;
+}
+
 int process_map_binary(struct process *process)
 {
-  return paging_map_to(process->task->page_directory->directory_entry,
-                       (void *)NUTSOS_PROGRAM_VIRTUAL_ADDRESS,
-                       process->ptr,
-                       paging_align_address(process->ptr + process->size),
-                       PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITEABLE);
+  int res = process_map_frames(process, (void *)NUTSOS_PROGRAM_VIRTUAL_ADDRESS, process->image_frames, process->image_frame_count);
+  if (ISERR(res)) {
+    return res;
+  }
+
+  // The page tables own the frames from now on
+  kfree(process->image_frames);
+  process->image_frames = 0;
+  process->image_frame_count = 0;
+  return 0;
 }
 
 int process_map_memory(struct process *process)
@@ -90,37 +231,384 @@ int process_map_memory(struct process *process)
     return res;
   }
 
-  res = paging_map_to(process->task->page_directory->directory_entry,
-                      (void *)NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END,
-                      process->stack,
-                      paging_align_address(process->stack + NUTSOS_USER_PROGRAM_STACK_SIZE),
-                      PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITEABLE);
+  // The stack is only backed by frames as it grows, the guard page right below it is never backed
+  res = process_add_region(process,
+                           (void *)NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END,
+                           (void *)NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START,
+                           PROCESS_REGION_WRITEABLE);
+  if (ISERR(res)) {
+    return res;
+  }
+
+  res = process_add_region(process,
+                           (void *)NUTSOS_PROGRAM_VIRTUAL_STACK_GUARD_ADDRESS,
+                           (void *)NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END,
+                           PROCESS_REGION_GUARD);
   return res;
 }
 
-int process_load(const char *filename, struct process **process)
+// Returns the first page from addr onwards (up to end) that can be mapped in directory, skipping the
+// ranges without a page table
+static uint32_t process_next_page(paging_dir *directory, uint32_t addr, uint32_t end)
+{
+  while (addr < end && !paging_is_table_present(directory, (void *)addr)) {
+    addr = addr - (addr % PAGING_TABLE_SPAN) + PAGING_TABLE_SPAN;
+  }
+
+  return addr;
+}
+
+// Returns the region holding addr, NULL if there's none
+static struct process_region *process_get_region(struct process *process, void *addr)
+{
+  for (int i = 0; i < NUTSOS_MAX_PROCESS_REGIONS; i++) {
+    struct process_region *region = &process->regions[i];
+    if (addr >= region->start && addr < region->end) {
+      return region;
+    }
+  }
+
+  return 0;
+}
+
+int process_add_region(struct process *process, void *start, void *end, uint8_t flags)
+{
+  if (!paging_is_aligned(start) || !paging_is_aligned(end) || end <= start || (uint32_t)end > NUTSOS_USER_SPACE_END) {
+    return -EINVARG;
+  }
+
+  struct process_region *free_region = 0;
+  for (int i = 0; i < NUTSOS_MAX_PROCESS_REGIONS; i++) {
+    struct process_region *region = &process->regions[i];
+    if (region->start == region->end) {
+      if (!free_region) {
+        free_region = region;
+      }
+      continue;
+    }
+
+    if (start < region->end && end > region->start) {
+      return -ETAKEN;
+    }
+  }
+
+  if (!free_region) {
+    return -ENOMEM;
+  }
+
+  // Pages already mapped for the process (the image), in memory or swapped out, can't be part of a region
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  uint32_t addr = process_next_page(directory, (uint32_t)start, (uint32_t)end);
+  for (; addr < (uint32_t)end; addr = process_next_page(directory, addr + PAGING_PAGE_SIZE, (uint32_t)end)) {
+    if (paging_get(directory, (void *)addr) & (PAGING_IS_PRESENT | PAGING_IS_SWAPPED)) {
+      return -ETAKEN;
+    }
+  }
+
+  free_region->start = start;
+  free_region->end = end;
+  free_region->flags = flags;
+  return 0;
+}
+
+int process_map_file(struct process *process, void *start, void *end, uint8_t flags, const char *filename, uint32_t offset)
+{
+  if (!paging_is_aligned((void *)offset) || ((flags & PROCESS_REGION_SHARED) && (flags & PROCESS_REGION_WRITEABLE))) {
+    return -EINVARG;
+  }
+
+  struct file_mapping *file = file_mapping_get(filename);
+  if (!file) {
+    return -EIO;
+  }
+
+  int res = process_add_region(process, start, end, flags);
+  if (ISERR(res)) {
+    file_mapping_put(file);
+    return res;
+  }
+
+  struct process_region *region = process_get_region(process, start);
+  region->file = file;
+  region->file_offset = offset;
+  return 0;
+}
+
+// Give the process its own copy of a copy-on-write page, the last owner left gets the page back writeable
+static int process_copy_on_write(struct process *process, void *page, paging_entry entry)
+{
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  paging_phys frame = PAGING_ENTRY_GET_ADDRESS(entry);
+  paging_entry flags = (PAGING_ENTRY_GET_FLAGS(entry) & ~PAGING_IS_COPY_ON_WRITE) | PAGING_IS_WRITEABLE;
+  if (frame_phys_get_refs(frame) == 1) {
+    return paging_map(directory, page, frame, flags);
+  }
+
+  paging_phys copy = process_alloc_user_frame(false);
+  if (!copy) {
+    return -ENOMEM;
+  }
+
+  // Either frame can be out of the kernel mapping of the RAM
+  memcpy(paging_kmap(0, copy), paging_kmap(1, frame), PAGING_PAGE_SIZE);
+  int res = paging_map(directory, page, copy, flags);
+  if (ISERR(res)) {
+    frame_phys_free(copy);
+    return res;
+  }
+
+  frame_phys_free(frame);
+  return 0;
+}
+
+// Read a swapped out page back in a frame of its own, with the flags it had
+static int process_swap_in(struct process *process, void *page, paging_entry entry)
+{
+  paging_phys frame = process_alloc_user_frame(false);
+  if (!frame) {
+    return -ENOMEM;
+  }
+
+  uint32_t slot = process_get_swap_slot(entry);
+  int res = swap_in(slot, frame);
+  if (ISERR(res)) {
+    frame_phys_free(frame);
+    return res;
+  }
+
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  paging_entry flags = (PAGING_ENTRY_GET_FLAGS(entry) & ~PAGING_IS_SWAPPED) | PAGING_IS_PRESENT;
+  res = paging_map(directory, page, frame, flags);
+  if (ISERR(res)) {
+    frame_phys_free(frame);
+    return res;
+  }
+
+  swap_free(slot);
+  return 0;
+}
+
+int process_page_fault(struct process *process, void *addr, uint32_t error)
+{
+  void *page = (void *)((uint32_t)addr - ((uint32_t)addr % PAGING_PAGE_SIZE));
+  paging_entry entry = paging_get(process->task->page_directory->directory_entry, page);
+  if ((error & IDT_PAGE_FAULT_PRESENT) && (error & IDT_PAGE_FAULT_WRITE) && (entry & PAGING_IS_COPY_ON_WRITE)) {
+    return process_copy_on_write(process, page, entry);
+  }
+
+  if (!(entry & PAGING_IS_PRESENT) && (entry & PAGING_IS_SWAPPED)) {
+    return process_swap_in(process, page, entry);
+  }
+
+  struct process_region *region = process_get_region(process, page);
+
+  // Only pages that haven't been touched yet can be fixed, anything else is a protection violation
+  if (!region || (region->flags & PROCESS_REGION_GUARD) || (error & IDT_PAGE_FAULT_PRESENT)) {
+    return -EFAULT;
+  }
+
+  if ((error & IDT_PAGE_FAULT_WRITE) && !(region->flags & PROCESS_REGION_WRITEABLE)) {
+    return -EFAULT;
+  }
+
+  // Regions only hold data, the code is in the program image
+  paging_phys frame = 0;
+  paging_entry flags = PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_NO_EXECUTE;
+  if (region->file) {
+    // Every mapping starts out with the page cached for the file, private ones copy it on the first write
+    void *cached = file_mapping_get_page(region->file, region->file_offset + (page - region->start));
+    frame = cached ? PAGING_VIRT_TO_PHYS(cached) : 0;
+    if (region->flags & PROCESS_REGION_WRITEABLE) {
+      flags |= PAGING_IS_COPY_ON_WRITE;
+    }
+  } else {
+    frame = process_alloc_user_frame(true);
+    if (region->flags & PROCESS_REGION_WRITEABLE) {
+      flags |= PAGING_IS_WRITEABLE;
+    }
+  }
+
+  if (!frame) {
+    return -ENOMEM;
+  }
+
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  int res = paging_map(directory, page, frame, flags);
+  if (ISERR(res)) {
+    frame_phys_free(frame);
+    return res;
+  }
+
+  // Don't wait for the write to fault again
+  if ((flags & PAGING_IS_COPY_ON_WRITE) && (error & IDT_PAGE_FAULT_WRITE)) {
+    res = process_copy_on_write(process, page, paging_get(directory, page));
+  }
+
+  return res;
+}
+
+// Give back the frames of all the user pages of the process, shared ones just lose a reference
+static void process_free_memory(struct process *process)
+{
+  paging_dir *directory = process->task->page_directory->directory_entry;
+  uint32_t addr = process_next_page(directory, 0, NUTSOS_USER_SPACE_END);
+  for (; addr < NUTSOS_USER_SPACE_END; addr = process_next_page(directory, addr + PAGING_PAGE_SIZE, NUTSOS_USER_SPACE_END)) {
+    paging_entry entry = paging_get(directory, (void *)addr);
+    if (process_is_user_page(entry)) {
+      frame_phys_free(PAGING_ENTRY_GET_ADDRESS(entry));
+    } else if (entry & PAGING_IS_SWAPPED) {
+      swap_free(process_get_swap_slot(entry));
+    }
+  }
+}
+
+void process_terminate(struct process *process)
 {
-  int process_slot = -1;
-  for (int i = 0; i < NUTSOS_MAX_PROCESSES; i++) {
+  if (process->task) {
+    process_free_memory(process);
+    task_free(process->task);
+  }
+
+  for (int i = 0; i < NUTSOS_MAX_PROCESS_REGIONS; i++) {
+    if (process->regions[i].file) {
+      file_mapping_put(process->regions[i].file);
+    }
+  }
+
+  if (process->image_frames) {
+    frame_free_batch(process->image_frames, process->image_frame_count);
+    kfree(process->image_frames);
+  }
+
+  if (processes[process->id] == process) {
+    processes[process->id] = 0;
+  }
+
+  kfree(process);
+}
+
+// Returns the first free process slot from first, -ENOMEM if there's none
+static int process_get_free_slot(int first)
+{
+  for (int i = first; i < NUTSOS_MAX_PROCESSES; i++) {
     if (processes[i] == 0) {
-      process_slot = i;
-      break;
+      return i;
     }
   }
 
+  return -ENOMEM;
+}
+
+int process_load(const char *filename, struct process **process)
+{
+  int process_slot = process_get_free_slot(0);
   if (process_slot < 0) {
-    return -ENOMEM;
+    return process_slot;
   }
 
   return process_load_for_slot(filename, process, process_slot);
 }
 
+// Share every user page of parent with child: writeable pages become read-only and copy-on-write in both
+// address spaces, swapped out ones share the swap slot
+static int process_share_memory(struct process *parent, struct process *child)
+{
+  paging_dir *parent_directory = parent->task->page_directory->directory_entry;
+  paging_dir *child_directory = child->task->page_directory->directory_entry;
+  uint32_t addr = process_next_page(parent_directory, 0, NUTSOS_USER_SPACE_END);
+  for (; addr < NUTSOS_USER_SPACE_END; addr = process_next_page(parent_directory, addr + PAGING_PAGE_SIZE, NUTSOS_USER_SPACE_END)) {
+    int res = 0;
+    void *page = (void *)addr;
+    paging_entry entry = paging_get(parent_directory, page);
+    if (!(entry & PAGING_IS_PRESENT) && (entry & PAGING_IS_SWAPPED)) {
+      // Each one reads its own copy back, whatever they write to it is private already
+      res = paging_set(child_directory, page, entry);
+      if (ISERR(res)) {
+        return res;
+      }
+
+      swap_ref(process_get_swap_slot(entry));
+      continue;
+    }
+
+    if (!process_is_user_page(entry)) {
+      continue;
+    }
+
+    if (entry & PAGING_IS_WRITEABLE) {
+      entry = (entry & ~PAGING_IS_WRITEABLE) | PAGING_IS_COPY_ON_WRITE;
+      res = paging_set(parent_directory, page, entry);
+    }
+
+    if (!ISERR(res)) {
+      res = paging_set(child_directory, page, entry);
+    }
+
+    if (ISERR(res)) {
+      return res;
+    }
+
+    frame_phys_ref(PAGING_ENTRY_GET_ADDRESS(entry));
+  }
+
+  return 0;
+}
+
+int process_fork(struct process *parent, struct process **out)
+{
+  // fork returns 0 in the child, so a child with id 0 would look like one to its parent
+  int process_slot = process_get_free_slot(1);
+  if (process_slot < 0) {
+    return process_slot;
+  }
+
+  struct process *process = kzalloc(sizeof(struct process));
+  if (!process) {
+    return -ENOMEM;
+  }
+
+  // Same image and regions, the pages behind them are shared below
+  int res = 0;
+  memcpy(process, parent, sizeof(struct process));
+  process->id = process_slot;
+  process->task = 0;
+  for (int i = 0; i < NUTSOS_MAX_PROCESS_REGIONS; i++) {
+    if (process->regions[i].file) {
+      file_mapping_ref(process->regions[i].file);
+    }
+  }
+
+  struct task *task = task_new(process);
+  if (ISERR(task)) {
+    res = PTRTOERR(task);
+    goto out;
+  }
+  process->task = task;
+
+  // The child resumes from the same system call as the parent, getting 0 back
+  task->registers = parent->task->registers;
+  task->registers.eax = 0;
+
+  res = process_share_memory(parent, process);
+  if (ISERR(res)) {
+    goto out;
+  }
+
+  *out = process;
+  processes[process_slot] = process;
+
+out:
+  if (ISERR(res)) {
+    process_terminate(process);
+  }
+  return res;
+}
+
 static int process_load_for_slot(const char *filename, struct process **out, int process_slot)
 {
   int res = 0;
   struct task *task = NULL;
   struct process *process = NULL;
-  void *program_stack_ptr = NULL;
 
   if (process_get(process_slot) != 0) {
     res = -ETAKEN;
@@ -139,22 +627,16 @@ static int process_load_for_slot(const char *filename, struct process **out, int
     goto out;
   }
 
-  program_stack_ptr = kzalloc(NUTSOS_USER_PROGRAM_STACK_SIZE);
-  if (!program_stack_ptr) {
-    res = -ENOMEM;
-    goto out;
-  }
-
   strncpy(process->filename, filename, sizeof(process->filename));
-  process->stack = program_stack_ptr;
   process->stack_virt = (uint32_t *)NUTSOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END;
-  process->stack_size = NUTSOS_USER_PROGRAM_STACK_SIZE;
+  process->stack_size = NUTSOS_USER_PROGRAM_STACK_MAX_SIZE;
   process->id = process_slot;
 
   // Create a task
   task = task_new(process);
   if (ISERR(task)) {
     res = PTRTOERR(task);
+    goto out;
   }
 
   process->task = task;
@@ -170,20 +652,26 @@ static int process_load_for_slot(const char *filename, struct process **out, int
   processes[process_slot] = process;
 
 out:
-  if (ISERR(res)) {
-    if (process && process->task) {
-      task_free(process->task);
-    }
-
-    // Free the process data
+  if (ISERR(res) && process) {
+    process_terminate(process);
   }
   return res;
 }
 
-// Validate a pointer to be in the range of the process' allocated space. Either as part of the stack of the process image
-// TODO: add check for extra allocations
+bool process_is_guard_page(struct process *process, void *addr)
+{
+  struct process_region *region = process_get_region(process, addr);
+  return region && (region->flags & PROCESS_REGION_GUARD);
+}
+
+// Validate a pointer to be in the range of the process' allocated space. Either as part of the process image or
+// of one of its regions (the stack among them)
 bool process_validate_pointer(struct process *process, void *ptr)
 {
-  return (ptr >= process->ptr_virt && ptr < process->ptr_virt + process->size) ||
-         (ptr >= process->stack_virt && ptr < process->stack_virt + process->stack_size);
+  if (ptr >= process->ptr_virt && ptr < process->ptr_virt + process->size) {
+    return true;
+  }
+
+  struct process_region *region = process_get_region(process, ptr);
+  return region && !(region->flags & PROCESS_REGION_GUARD);
 }
\ No newline at end of file
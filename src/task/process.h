@@ -4,6 +4,31 @@
 #include "task.h"
 #include <stdint.h>
 
+// The pages of the region can be written to
+#define PROCESS_REGION_WRITEABLE 0b00000001
+// File regions only: the pages are the ones cached for the file, seen by every process mapping it
+// (read-only). Otherwise writes go to a private copy of the page
+#define PROCESS_REGION_SHARED    0b00000010
+// The pages of the region are never backed, any access to them faults. Keeps the other regions away
+// from the bottom of the stack
+#define PROCESS_REGION_GUARD     0b00000100
+
+struct file_mapping;
+
+// A range of user memory backed by a frame page by page, the first time each page is touched.
+// Pages are zero-filled, or read from a file for regions mapping one
+struct process_region {
+  // Page aligned, end excluded. Unused regions have start == end
+  void *start;
+  void *end;
+
+  uint8_t flags;
+
+  // The file mapped in the region (NULL for zero-filled memory) and the offset in the file of start
+  struct file_mapping *file;
+  uint32_t file_offset;
+};
+
 struct process {
   // The process id
   uint16_t id;
@@ -16,26 +41,52 @@ struct process {
   // The memory (malloc) allocations of the process
   void *allocations[1024]; // TODO convert this to a linked list of zones
 
-  // The physical pointer to the process image
-  void *ptr;
+  // The physical frames holding the process image, only until they're mapped (the page tables own them after)
+  void **image_frames;
+
+  // Number of frames in image_frames
+  uint32_t image_frame_count;
 
   // The virtual pointer to the process image
   void *ptr_virt;
 
-  // The physical pointer to the stack memory
-  void *stack;
+  // The demand-zero memory of the process (the stack among others)
+  struct process_region regions[NUTSOS_MAX_PROCESS_REGIONS];
 
-  // The virtual pointer to the stack memory
+  // The lowest address the stack can grow down to
   void *stack_virt;
 
-  // Size of the process'stack
+  // Maximum size of the process'stack
   uint32_t stack_size;
 
-  // The size of the data pointed to by "ptr"
+  // The size of the process image
   uint32_t size;
 };
 
 int process_load(const char *filename, struct process **process);
 bool process_validate_pointer(struct process *process, void *ptr);
 
+// Declare the pages between start and end (page aligned, below NUTSOS_USER_SPACE_END) as demand-zero
+// memory of the process. Nothing is allocated until the pages are touched
+int process_add_region(struct process *process, void *start, void *end, uint8_t flags);
+
+// Map offset (page aligned) onwards of filename between start and end (see process_add_region), the pages
+// are read from the file when first touched. Shared regions can't be writeable
+int process_map_file(struct process *process, void *start, void *end, uint8_t flags, const char *filename, uint32_t offset);
+
+// Back the page holding addr with a frame if it's in one of the process' regions (or copy it if it's
+// copy-on-write).
+// error is the error code of the page fault, returns -EFAULT if the access is not allowed
+int process_page_fault(struct process *process, void *addr, uint32_t error);
+
+// Returns true if addr is in a guard region of the process (the stack overflowed if it was accessed)
+bool process_is_guard_page(struct process *process, void *addr);
+
+// Free the process, its task and all of its memory
+void process_terminate(struct process *process);
+
+// Create a copy of parent sharing all of its pages copy-on-write, the new process resumes from the same
+// point as the parent's task (with eax set to 0)
+int process_fork(struct process *parent, struct process **out);
+
 #endif
\ No newline at end of file
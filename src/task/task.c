@@ -67,6 +67,9 @@ static void task_list_remove(struct task *task)
 {
   if (task->prev) {
     task->prev->next = task->next;
+  }
+
+  if (task->next) {
     task->next->prev = task->prev;
   }
 
@@ -78,13 +81,19 @@ static void task_list_remove(struct task *task)
     task_tail = task->prev;
   }
 
+  // Nothing is running until task_next picks another task
   if (task == current_task) {
-    current_task = task_get_next();
+    current_task = 0;
   }
 }
 
 void task_free(struct task *task)
 {
+  // Don't pull the page directory in use from under the kernel's feet
+  if (task == current_task) {
+    paging_switch(paging_chunk_get_directory(kernel_get_paging_chunk()));
+  }
+
   paging_chunk_free(task->page_directory);
   task_list_remove(task);
 
@@ -95,8 +104,8 @@ void task_free(struct task *task)
 static int task_init(struct task *task, struct process *process)
 {
   memset(task, 0, sizeof(struct task));
-  // Give 4GB of paging to this task
-  task->page_directory = paging_chunk_new(PAGING_TOTAL_DIR_ENTRIES, PAGING_TOTAL_ENTRIES_PER_TABLE, PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+  // Start from the kernel mappings, the task's own pages are mapped on top later
+  task->page_directory = paging_chunk_new_shared(kernel_get_paging_chunk());
   if (!task->page_directory) {
     return -EIO;
   }
@@ -125,6 +134,22 @@ int task_switch(struct task *task)
 //   return 0;
 // }
 
+struct task *task_current()
+{
+  return current_task;
+}
+
+void task_next()
+{
+  struct task *task = current_task ? task_get_next() : task_head;
+  if (!task) {
+    panic("No tasks left to run\n");
+  }
+
+  task_switch(task);
+  task_return(&task->registers);
+}
+
 void task_run_as_task0(struct task *task)
 {
   if (task != task_head) {
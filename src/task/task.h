@@ -48,6 +48,13 @@ struct task *task_get_next();
 void task_free(struct task *task);
 void task_run_as_task0(struct task *task);
 
+// Returns the task that is running, NULL if there's none
+struct task *task_current();
+
+// Switch to the task after the current one (the first one if the current task has been freed) and
+// resume it where it was interrupted. Never returns
+void task_next();
+
 struct interrupt_frame;
 void task_current_save_state(struct interrupt_frame *frame);
 void *task_current_get_stack_item(int index);
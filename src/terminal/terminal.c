@@ -1,4 +1,5 @@
 #include "terminal.h"
+#include "config.h"
 #include "stdutil/string.h"
 
 #include <stdarg.h>
@@ -36,7 +37,7 @@ void terminal_writechar(char c, char colour)
 }
 void terminal_initialize()
 {
-  video_mem = (uint16_t *)(0xB8000);
+  video_mem = (uint16_t *)(NUTSOS_KERNEL_VIRTUAL_BASE + 0xB8000);
   terminal_row = 0;
   terminal_col = 0;
   for (int y = 0; y < VGA_HEIGHT; y++) {
@@ -58,6 +59,7 @@ void printf(const char *fmt, ...)
 {
   va_list args;
   va_start(args, fmt);
+  char num[33];
 
   for (const char *ptr = fmt; *ptr != '\0'; ptr++) {
     if (*ptr == '%') {
@@ -66,6 +68,23 @@ void printf(const char *fmt, ...)
       case 's':
         print(va_arg(args, char *));
         break;
+      case 'd': {
+        int value = va_arg(args, int);
+        uint32_t magnitude = value;
+        if (value < 0) {
+          terminal_writechar('-', 15);
+          // Negating in unsigned arithmetic also works for INT_MIN
+          magnitude = 0u - (uint32_t)value;
+        }
+        print(utoa(magnitude, num, 10));
+        break;
+      }
+      case 'u':
+        print(utoa(va_arg(args, uint32_t), num, 10));
+        break;
+      case 'x':
+        print(utoa(va_arg(args, uint32_t), num, 16));
+        break;
       case '%': // literal %
         terminal_writechar('%', 15);
         break;
@@ -0,0 +1,633 @@
+// Host build of the kernel heap (src/memory/heap) for benchmarking and fuzzing allocator changes
+// without booting the kernel. heap.c and buddy.c are compiled as they are against a malloc'd arena,
+// the backend is chosen at build time through NUTSOS_HEAP_BACKEND like in the kernel.
+//
+// A run replays an allocation trace twice on a fresh heap:
+// - a checked pass that verifies after every op that allocations don't overlap and, every
+//   -c ops, that the heap table is consistent (chains, summary counts, free lists, zeroed blocks)
+// - a timed pass that only calls the heap, reported in ns per op
+// followed by the fragmentation of the heap at the end of the trace.
+//
+// Traces are text files, one op per line ('#' starts a comment):
+//   a <id> <bytes>   heap_malloc, the allocation is known as id from then on
+//   z <id> <bytes>   heap_zalloc
+//   r <id> <bytes>   heap_resize in place, falling back to allocate, copy and free (like krealloc)
+//   f <id>           heap_free
+//   i <blocks>       heap_zero_free_blocks, as the kernel does when idle
+// Synthetic traces are generated with -s and can be saved with -w to be edited and replayed.
+#include "config.h"
+#include "memory/heap/heap.h"
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HEAPBENCH_MAX_IDS        65536
+#define HEAPBENCH_DEFAULT_BLOCKS 16384
+#define HEAPBENCH_DEFAULT_OPS    200000
+#define HEAPBENCH_DEFAULT_CHECK  1000
+
+// Filled in the allocations by the checked pass, so that zalloc and the IS_ZERO bits are put to the test
+#define HEAPBENCH_DIRTY_BYTE     0xA5
+
+struct heapbench_op {
+  char type;
+  int id;
+  size_t value;
+};
+
+struct heapbench_trace {
+  struct heapbench_op *ops;
+  int count;
+  int capacity;
+};
+
+struct heapbench_allocation {
+  void *ptr;
+  size_t size;
+};
+
+struct heapbench {
+  struct heap heap;
+  struct heap_table table;
+  void *arena;
+  size_t blocks;
+
+  struct heapbench_allocation allocations[HEAPBENCH_MAX_IDS];
+
+  // Id of the allocation (plus one) owning each block, to catch overlapping allocations
+  int *owners;
+
+  bool checked;
+  int check_interval;
+
+  size_t live_bytes;
+  size_t peak_live_bytes;
+  int failed;
+};
+
+void panic(const char *msg)
+{
+  fprintf(stderr, "panic: %s", msg);
+  abort();
+}
+
+static void heapbench_fail(const char *msg, int op, size_t value)
+{
+  fprintf(stderr, "heapbench: %s (op %d, %zu)\n", msg, op, value);
+  exit(1);
+}
+
+static void heapbench_trace_add(struct heapbench_trace *trace, char type, int id, size_t value)
+{
+  if (trace->count == trace->capacity) {
+    trace->capacity = trace->capacity ? trace->capacity * 2 : 1024;
+    trace->ops = realloc(trace->ops, trace->capacity * sizeof(struct heapbench_op));
+    if (!trace->ops) {
+      heapbench_fail("out of memory", trace->count, 0);
+    }
+  }
+
+  trace->ops[trace->count].type = type;
+  trace->ops[trace->count].id = id;
+  trace->ops[trace->count].value = value;
+  trace->count++;
+}
+
+static int heapbench_trace_load(struct heapbench_trace *trace, const char *filename)
+{
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    return -1;
+  }
+
+  char line[256];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    char type;
+    int id = 0;
+    size_t value = 0;
+    if (sscanf(line, " %c", &type) != 1 || type == '#') {
+      continue;
+    }
+
+    int fields = 0;
+    switch (type) {
+    case 'a':
+    case 'z':
+    case 'r':
+      fields = sscanf(line, " %c %d %zu", &type, &id, &value) == 3;
+      break;
+    case 'f':
+      fields = sscanf(line, " %c %d", &type, &id) == 2;
+      break;
+    case 'i':
+      fields = sscanf(line, " %c %zu", &type, &value) == 2;
+      break;
+    }
+
+    if (!fields || id < 0 || id >= HEAPBENCH_MAX_IDS) {
+      fprintf(stderr, "heapbench: %s:%d: invalid op\n", filename, line_number);
+      fclose(file);
+      return -1;
+    }
+
+    heapbench_trace_add(trace, type, id, value);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+static int heapbench_trace_save(struct heapbench_trace *trace, const char *filename)
+{
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    return -1;
+  }
+
+  for (int i = 0; i < trace->count; i++) {
+    struct heapbench_op *op = &trace->ops[i];
+    switch (op->type) {
+    case 'f':
+      fprintf(file, "f %d\n", op->id);
+      break;
+    case 'i':
+      fprintf(file, "i %zu\n", op->value);
+      break;
+    default:
+      fprintf(file, "%c %d %zu\n", op->type, op->id, op->value);
+      break;
+    }
+  }
+
+  fclose(file);
+  return 0;
+}
+
+static uint32_t heapbench_random_state = 1;
+
+// Same LCG as the kernel benchmarks, runs only need to be repeatable
+static uint32_t heapbench_random()
+{
+  heapbench_random_state = heapbench_random_state * 1103515245 + 12345;
+  return heapbench_random_state >> 8;
+}
+
+// Synthetic workloads:
+// - random: allocations of 1 to 64 blocks of random size, freed in random order
+// - small: mostly one or two block allocations, like the slab layer and the paging structures
+// - grow: buffers that keep being resized up (and sometimes down) between other allocations
+static int heapbench_trace_generate(struct heapbench_trace *trace, const char *workload, int ops, size_t blocks)
+{
+  // Ids in use and free ids, so that an id is never reused while live
+  static int live[HEAPBENCH_MAX_IDS];
+  static int free_ids[HEAPBENCH_MAX_IDS];
+  int live_count = 0;
+  int free_count = HEAPBENCH_MAX_IDS;
+  for (int i = 0; i < HEAPBENCH_MAX_IDS; i++) {
+    free_ids[i] = HEAPBENCH_MAX_IDS - 1 - i;
+  }
+  bool grow = strcmp(workload, "grow") == 0;
+  bool small = strcmp(workload, "small") == 0;
+  if (!grow && !small && strcmp(workload, "random") != 0) {
+    return -1;
+  }
+
+  // Cap the live allocations so that the heap ends up around half full
+  size_t average_blocks = small ? 1 : 32;
+  int max_live = blocks / (2 * average_blocks);
+  // Resizes take some of the allocations' share of ops, free less often to keep up
+  uint32_t free_odds = grow ? 30 : 45;
+  if (max_live > HEAPBENCH_MAX_IDS) {
+    max_live = HEAPBENCH_MAX_IDS;
+  }
+
+  for (int i = 0; i < ops; i++) {
+    uint32_t dice = heapbench_random() % 100;
+    if (dice == 0) {
+      heapbench_trace_add(trace, 'i', 0, 1 + heapbench_random() % 64);
+      continue;
+    }
+
+    if (live_count && (live_count >= max_live || dice < free_odds)) {
+      int index = heapbench_random() % live_count;
+      heapbench_trace_add(trace, 'f', live[index], 0);
+      free_ids[free_count++] = live[index];
+      live[index] = live[--live_count];
+      continue;
+    }
+
+    if (grow && live_count && dice < 60) {
+      int index = heapbench_random() % live_count;
+      heapbench_trace_add(trace, 'r', live[index], NUTSOS_HEAP_BLOCK_SIZE * (1 + heapbench_random() % 64));
+      continue;
+    }
+
+    size_t size = small ? 1 + heapbench_random() % (2 * NUTSOS_HEAP_BLOCK_SIZE)
+                        : 1 + heapbench_random() % (64 * NUTSOS_HEAP_BLOCK_SIZE);
+    int id = free_ids[--free_count];
+    heapbench_trace_add(trace, dice % 4 == 0 ? 'z' : 'a', id, size);
+    live[live_count++] = id;
+  }
+
+  return 0;
+}
+
+static size_t heapbench_block_of(struct heapbench *bench, void *ptr)
+{
+  return (size_t)(ptr - bench->arena) / NUTSOS_HEAP_BLOCK_SIZE;
+}
+
+// Claim the blocks of a new allocation in the owners map, they must all be unowned
+static void heapbench_claim(struct heapbench *bench, int op, int id, void *ptr, size_t size)
+{
+  if (ptr < bench->arena || heapbench_block_of(bench, ptr) >= bench->blocks ||
+      (size_t)(ptr - bench->arena) % NUTSOS_HEAP_BLOCK_SIZE) {
+    heapbench_fail("allocation outside of the heap or not block aligned", op, (size_t)ptr);
+  }
+
+  size_t actual = heap_allocation_size(&bench->heap, ptr);
+  size_t first = heapbench_block_of(bench, ptr);
+  size_t count = actual / NUTSOS_HEAP_BLOCK_SIZE;
+  if (actual < size || first + count > bench->blocks) {
+    heapbench_fail("allocation smaller than requested", op, actual);
+  }
+
+  for (size_t i = first; i < first + count; i++) {
+    if (bench->owners[i]) {
+      heapbench_fail("overlapping allocations", op, i);
+    }
+    bench->owners[i] = id + 1;
+  }
+}
+
+static void heapbench_release(struct heapbench *bench, void *ptr)
+{
+  size_t first = heapbench_block_of(bench, ptr);
+  size_t count = heap_allocation_size(&bench->heap, ptr) / NUTSOS_HEAP_BLOCK_SIZE;
+  for (size_t i = first; i < first + count; i++) {
+    bench->owners[i] = 0;
+  }
+}
+
+static bool heapbench_is_zero(void *ptr, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    if (((uint8_t *)ptr)[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if NUTSOS_HEAP_BACKEND == NUTSOS_HEAP_BACKEND_BLOCK
+// Chains of HAS_NEXT must start with IS_FIRST and match the owners map, free blocks can only
+// carry IS_ZERO (and then be zero-filled) and the group and super group counts must add up
+static void heapbench_check_table(struct heapbench *bench, int op)
+{
+  struct heap_table *table = &bench->table;
+  size_t group_free = 0;
+  size_t super_free = 0;
+  for (size_t i = 0; i < table->total; i++) {
+    heap_block_table_entry_t entry = table->entries[i];
+    if (!(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN)) {
+      if (bench->owners[i] || (entry & ~HEAP_BLOCK_IS_ZERO)) {
+        heapbench_fail("free block owned or with chain bits", op, i);
+      }
+      if ((entry & HEAP_BLOCK_IS_ZERO) && !heapbench_is_zero(bench->arena + i * NUTSOS_HEAP_BLOCK_SIZE, NUTSOS_HEAP_BLOCK_SIZE)) {
+        heapbench_fail("block marked zero is not zero-filled", op, i);
+      }
+      group_free++;
+      super_free++;
+    } else {
+      bool first = i == 0 || bench->owners[i - 1] != bench->owners[i];
+      bool last = i == table->total - 1 || bench->owners[i + 1] != bench->owners[i];
+      if (!bench->owners[i] || first != !!(entry & HEAP_BLOCK_IS_FIRST) || last == !!(entry & HEAP_BLOCK_HAS_NEXT)) {
+        heapbench_fail("inconsistent allocation chain", op, i);
+      }
+    }
+
+    if ((i + 1) % HEAP_TABLE_GROUP_BLOCKS == 0 || i == table->total - 1) {
+      if (table->group_free[i / HEAP_TABLE_GROUP_BLOCKS] != group_free) {
+        heapbench_fail("wrong group free count", op, i / HEAP_TABLE_GROUP_BLOCKS);
+      }
+      group_free = 0;
+    }
+
+    if ((i + 1) % HEAP_TABLE_SUPER_BLOCKS == 0 || i == table->total - 1) {
+      if (table->super_free[i / HEAP_TABLE_SUPER_BLOCKS] != super_free) {
+        heapbench_fail("wrong super group free count", op, i / HEAP_TABLE_SUPER_BLOCKS);
+      }
+      super_free = 0;
+    }
+  }
+}
+#else
+// Chunks must tile the heap, be aligned to their size and match the owners map,
+// and every free chunk must be in the free list of its order
+static void heapbench_check_table(struct heapbench *bench, int op)
+{
+  struct heap_table *table = &bench->table;
+  size_t free_chunks[HEAP_BUDDY_MAX_ORDER + 1] = {};
+  size_t block = 0;
+  while (block < table->total) {
+    heap_block_table_entry_t entry = table->entries[block];
+    int order = (entry & HEAP_BLOCK_MASK_ORDER) >> HEAP_BLOCK_ORDER_SHIFT;
+    size_t chunk_blocks = (size_t)1 << order;
+    if (!(entry & HEAP_BLOCK_IS_FIRST) || block % chunk_blocks || block + chunk_blocks > table->total) {
+      heapbench_fail("chunks don't tile the heap", op, block);
+    }
+
+    int owner = bench->owners[block];
+    for (size_t i = block; i < block + chunk_blocks; i++) {
+      if (i != block && table->entries[i] != HEAP_BLOCK_TABLE_ENTRY_FREE) {
+        heapbench_fail("entry used inside a chunk", op, i);
+      }
+      if (bench->owners[i] != owner || (owner != 0) != !!(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN)) {
+        heapbench_fail("chunk doesn't match its allocation", op, i);
+      }
+    }
+
+    if (!(entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN)) {
+      free_chunks[order]++;
+    }
+    block += chunk_blocks;
+  }
+
+  for (int order = 0; order <= HEAP_BUDDY_MAX_ORDER; order++) {
+    size_t count = 0;
+    struct heap_buddy_node *prev = 0;
+    for (struct heap_buddy_node *node = bench->heap.free_lists[order]; node; node = node->next) {
+      size_t node_block = heapbench_block_of(bench, node);
+      heap_block_table_entry_t entry = table->entries[node_block];
+      if (node->prev != prev || (entry & HEAP_BLOCK_TABLE_ENTRY_TAKEN) ||
+          ((entry & HEAP_BLOCK_MASK_ORDER) >> HEAP_BLOCK_ORDER_SHIFT) != order) {
+        heapbench_fail("corrupted free list", op, order);
+      }
+      prev = node;
+      count++;
+    }
+
+    if (count != free_chunks[order]) {
+      heapbench_fail("free chunk missing from its list", op, order);
+    }
+  }
+}
+#endif
+
+static void *heapbench_alloc(struct heapbench *bench, int op, struct heapbench_op *trace_op)
+{
+  void *ptr = trace_op->type == 'z' ? heap_zalloc(&bench->heap, trace_op->value) : heap_malloc(&bench->heap, trace_op->value);
+  if (!ptr || !bench->checked) {
+    return ptr;
+  }
+
+  heapbench_claim(bench, op, trace_op->id, ptr, trace_op->value);
+  if (trace_op->type == 'z' && !heapbench_is_zero(ptr, trace_op->value)) {
+    heapbench_fail("zalloc returned dirty memory", op, trace_op->value);
+  }
+  memset(ptr, HEAPBENCH_DIRTY_BYTE, trace_op->value);
+  return ptr;
+}
+
+static void heapbench_free(struct heapbench *bench, void *ptr)
+{
+  if (bench->checked) {
+    heapbench_release(bench, ptr);
+  }
+  heap_free(&bench->heap, ptr);
+}
+
+// Resize in place or allocate, copy and free like krealloc does
+static void *heapbench_resize(struct heapbench *bench, int op, struct heapbench_op *trace_op, struct heapbench_allocation *allocation)
+{
+  size_t size = trace_op->value;
+  if (bench->checked) {
+    heapbench_release(bench, allocation->ptr);
+  }
+
+  if (heap_resize(&bench->heap, allocation->ptr, size) == 0) {
+    if (bench->checked) {
+      heapbench_claim(bench, op, trace_op->id, allocation->ptr, size);
+      memset(allocation->ptr, HEAPBENCH_DIRTY_BYTE, size);
+    }
+    return allocation->ptr;
+  }
+
+  if (bench->checked) {
+    heapbench_claim(bench, op, trace_op->id, allocation->ptr, allocation->size);
+  }
+
+  void *ptr = heapbench_alloc(bench, op, trace_op);
+  if (!ptr) {
+    return 0;
+  }
+
+  memcpy(ptr, allocation->ptr, allocation->size < size ? allocation->size : size);
+  heapbench_free(bench, allocation->ptr);
+  return ptr;
+}
+
+static void heapbench_replay(struct heapbench *bench, struct heapbench_trace *trace)
+{
+  for (int i = 0; i < trace->count; i++) {
+    struct heapbench_op *op = &trace->ops[i];
+    struct heapbench_allocation *allocation = &bench->allocations[op->id];
+    switch (op->type) {
+    case 'a':
+    case 'z':
+      if (allocation->ptr) {
+        heapbench_free(bench, allocation->ptr);
+        bench->live_bytes -= allocation->size;
+      }
+      allocation->ptr = heapbench_alloc(bench, i, op);
+      allocation->size = allocation->ptr ? op->value : 0;
+      bench->live_bytes += allocation->size;
+      bench->failed += !allocation->ptr;
+      break;
+
+    case 'r':
+      if (!allocation->ptr) {
+        break;
+      }
+
+      void *ptr = heapbench_resize(bench, i, op, allocation);
+      if (ptr) {
+        bench->live_bytes = bench->live_bytes - allocation->size + op->value;
+        allocation->ptr = ptr;
+        allocation->size = op->value;
+      } else {
+        bench->failed++;
+      }
+      break;
+
+    case 'f':
+      if (allocation->ptr) {
+        heapbench_free(bench, allocation->ptr);
+        bench->live_bytes -= allocation->size;
+        allocation->ptr = 0;
+        allocation->size = 0;
+      }
+      break;
+
+    case 'i':
+      heap_zero_free_blocks(&bench->heap, op->value);
+      break;
+    }
+
+    if (bench->live_bytes > bench->peak_live_bytes) {
+      bench->peak_live_bytes = bench->live_bytes;
+    }
+
+    if (bench->checked && bench->check_interval && (i + 1) % bench->check_interval == 0) {
+      heapbench_check_table(bench, i);
+    }
+  }
+
+  if (bench->checked) {
+    heapbench_check_table(bench, trace->count);
+  }
+}
+
+static void heapbench_setup(struct heapbench *bench, size_t blocks, bool checked, int check_interval)
+{
+  memset(bench, 0, sizeof(struct heapbench));
+  bench->blocks = blocks;
+  bench->checked = checked;
+  bench->check_interval = check_interval;
+  bench->arena = aligned_alloc(NUTSOS_HEAP_BLOCK_SIZE, blocks * NUTSOS_HEAP_BLOCK_SIZE);
+  bench->table.entries = malloc(heap_table_size(blocks));
+  bench->table.total = blocks;
+  bench->owners = calloc(blocks, sizeof(int));
+  if (!bench->arena || !bench->table.entries || !bench->owners) {
+    heapbench_fail("out of memory", 0, blocks);
+  }
+
+  // Start from dirty memory like the kernel does
+  memset(bench->arena, HEAPBENCH_DIRTY_BYTE, blocks * NUTSOS_HEAP_BLOCK_SIZE);
+  if (heap_create(&bench->heap, bench->arena, bench->arena + blocks * NUTSOS_HEAP_BLOCK_SIZE, &bench->table) < 0) {
+    heapbench_fail("heap_create failed", 0, blocks);
+  }
+}
+
+static void heapbench_teardown(struct heapbench *bench)
+{
+  free(bench->arena);
+  free(bench->table.entries);
+  free(bench->owners);
+}
+
+static void heapbench_usage()
+{
+  fprintf(stderr,
+          "usage: heapbench [-t trace | -s random|small|grow] [-n ops] [-b blocks] [-c interval] [-S seed] [-w out]\n"
+          "  -t  replay a recorded trace\n"
+          "  -s  generate a synthetic trace (default: random)\n"
+          "  -n  ops of the synthetic trace (default: %d)\n"
+          "  -b  heap size in blocks (default: %d)\n"
+          "  -c  check the whole heap table every interval ops, 0 only at the end (default: %d)\n"
+          "  -S  seed of the synthetic trace\n"
+          "  -w  save the trace to out\n",
+          HEAPBENCH_DEFAULT_OPS,
+          HEAPBENCH_DEFAULT_BLOCKS,
+          HEAPBENCH_DEFAULT_CHECK);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *trace_file = 0;
+  const char *workload = "random";
+  const char *out_file = 0;
+  int ops = HEAPBENCH_DEFAULT_OPS;
+  size_t blocks = HEAPBENCH_DEFAULT_BLOCKS;
+  int check_interval = HEAPBENCH_DEFAULT_CHECK;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:s:n:b:c:S:w:")) != -1) {
+    switch (opt) {
+    case 't':
+      trace_file = optarg;
+      break;
+    case 's':
+      workload = optarg;
+      break;
+    case 'n':
+      ops = atoi(optarg);
+      break;
+    case 'b':
+      blocks = strtoul(optarg, 0, 10);
+      break;
+    case 'c':
+      check_interval = atoi(optarg);
+      break;
+    case 'S':
+      heapbench_random_state = strtoul(optarg, 0, 10);
+      break;
+    case 'w':
+      out_file = optarg;
+      break;
+    default:
+      heapbench_usage();
+    }
+  }
+
+  if (blocks == 0 || ops < 0) {
+    heapbench_usage();
+  }
+
+  struct heapbench_trace trace = {};
+  if (trace_file ? heapbench_trace_load(&trace, trace_file) < 0 : heapbench_trace_generate(&trace, workload, ops, blocks) < 0) {
+    fprintf(stderr, "heapbench: unable to load trace %s\n", trace_file ? trace_file : workload);
+    return 1;
+  }
+
+  if (out_file && heapbench_trace_save(&trace, out_file) < 0) {
+    fprintf(stderr, "heapbench: unable to write %s\n", out_file);
+    return 1;
+  }
+
+  static struct heapbench bench;
+  heapbench_setup(&bench, blocks, true, check_interval);
+  heapbench_replay(&bench, &trace);
+  heapbench_teardown(&bench);
+
+  heapbench_setup(&bench, blocks, false, 0);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  heapbench_replay(&bench, &trace);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  struct heap_fragmentation frag;
+  heap_get_fragmentation(&bench.heap, &frag);
+
+  printf("backend: %s, heap: %zu blocks, trace: %s (%d ops)\n",
+         NUTSOS_HEAP_BACKEND == NUTSOS_HEAP_BACKEND_BUDDY ? "buddy" : "block",
+         blocks,
+         trace_file ? trace_file : workload,
+         trace.count);
+  printf("checks: passed\n");
+  printf("time: %.1f ns/op, %d failed allocations, peak live %zu KiB\n",
+         trace.count ? ns / trace.count : 0,
+         bench.failed,
+         bench.peak_live_bytes / 1024);
+  printf("fragmentation: %zu free blocks in %zu runs, largest run %zu blocks (%.1f%% of free)\n",
+         frag.free_blocks,
+         frag.free_runs,
+         frag.largest_free_run,
+         frag.free_blocks ? 100.0 * frag.largest_free_run / frag.free_blocks : 100.0);
+  printf("free runs by size:");
+  for (int i = 0; i < HEAP_FRAGMENTATION_BUCKETS; i++) {
+    printf(" %d%s:%u", 1 << i, i == HEAP_FRAGMENTATION_BUCKETS - 1 ? "+" : "", frag.run_histogram[i]);
+  }
+  printf("\n");
+
+  heapbench_teardown(&bench);
+  free(trace.ops);
+  return 0;
+}